@@ -0,0 +1,204 @@
+/*
+ * RnDuPass的字段敏感的访问路径
+ *
+ * 访问路径由变量以及依次访问的结构体字段与数组下标组成, 如s.f[2].g写作s.1[2].0: 字段按编号命名,
+ * 因为-O0时GEP的名字是每次访问各自唯一的. 通过指针的访问先解引用, *p与p[0]相同, p->f为p[0].1.
+ * 路径在表中哈希合并(hash-consing): 每个路径是<上一级路径, 最后一个字段或下标>上唯一的编号, 相同的路径只存一份.
+ * 遇到变量下标或指针类型的转换时, 后面的部分无法确定, 路径截断为前缀; 前缀与其所有的后继都可能重叠
+ */
+#ifndef RN_ACCESS_PATH_H
+#define RN_ACCESS_PATH_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Operator.h"
+
+
+class RnPathTable {
+public:
+  static const uint32_t NoParent = ~0u;
+
+  void clear() {
+    Nodes.clear();
+    Ids.clear();
+    ByName.clear();
+    Cache.clear();
+  }
+
+  size_t size() const { return Nodes.size(); }
+
+  /**
+   * @brief 获取<上一级路径, 字段或下标>对应的路径, 没有时创建
+   *
+   * @param Parent 为NoParent时Comp为变量名
+   * @param Comp ".字段编号"或"[下标]"
+   * @return uint32_t
+   */
+  uint32_t getChild(uint32_t Parent, const std::string &Comp) {
+    auto key = std::make_pair(Parent, Comp);
+    auto it = Ids.find(key);
+    if (it != Ids.end())
+      return it->second;
+
+    uint32_t id = Nodes.size();
+    Nodes.push_back(RnPathNode{Parent, Parent == NoParent ? Comp : Nodes[Parent].Name + Comp});
+    Ids.emplace(std::move(key), id);
+    ByName[Nodes[id].Name] = id;
+    return id;
+  }
+
+  uint32_t getRoot(const std::string &Name) { return getChild(NoParent, Name); }
+  const std::string &getName(uint32_t Id) const { return Nodes[Id].Name; }
+  uint32_t getParent(uint32_t Id) const { return Nodes[Id].Parent; }
+
+  /**
+   * @brief A是否是Id的上级路径(不包括Id自身)
+   *
+   * @param A
+   * @param Id
+   * @return true
+   * @return false
+   */
+  bool isAncestor(uint32_t A, uint32_t Id) const {
+    while (Nodes[Id].Parent != NoParent) {
+      Id = Nodes[Id].Parent;
+      if (Id == A)
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief 按名字查找路径
+   *
+   * @param Name
+   * @return int 没有时为-1
+   */
+  int find(llvm::StringRef Name) const {
+    auto it = ByName.find(Name);
+    return it != ByName.end() ? (int)it->second : -1;
+  }
+
+  /* <指针, <其指向的位置的路径, 路径是否确切>>, 路径为-1时无法获取 */
+  llvm::DenseMap<const llvm::Value *, std::pair<int, bool>> Cache;
+
+private:
+  struct RnPathNode {
+    uint32_t Parent;
+    std::string Name;
+  };
+
+  std::vector<RnPathNode> Nodes;
+  std::map<std::pair<uint32_t, std::string>, uint32_t> Ids;
+  llvm::StringMap<uint32_t> ByName;
+};
+
+
+/**
+ * @brief 从指针沿GEP, load与类型转换向前找到变量, 获取指针指向的位置的访问路径
+ *
+ * @param Table
+ * @param Ptr
+ * @param MaxDepth 路径中最多保留的字段与下标数, 超出的部分截断
+ * @param Exact 不为空时写入路径是否确切: 没有截断, 也没有经过指针的解引用, 即指针总是指向该路径的整个位置
+ * @return int 路径, 指针不是来自有名字的变量(alloca, 全局变量, 形参)时为-1
+ */
+static inline int getRnAccessPath(RnPathTable &Table, llvm::Value *Ptr, unsigned MaxDepth, bool *Exact = nullptr) {
+  auto cached = Table.Cache.find(Ptr);
+  if (cached != Table.Cache.end()) {
+    if (Exact)
+      *Exact = cached->second.second;
+    return cached->second.first;
+  }
+
+  int path = -1;
+  bool exact = true;
+  std::vector<std::string> comps; // 从叶向根的字段与下标
+  bool derefDone = false;         // 上一步的GEP的第一个下标已经是对指针的解引用
+  llvm::Value *V = Ptr;
+  for (int steps = 0; V && steps < 64; steps++) {
+
+    if (llvm::isa<llvm::AllocaInst>(V) || llvm::isa<llvm::GlobalVariable>(V) || llvm::isa<llvm::Argument>(V)) {
+      if (V->hasName()) {
+        std::string name = V->getName().str();
+        uint32_t id = Table.getRoot(name.substr(0, name.find(".addr")));
+        unsigned depth = 0;
+        for (auto it = comps.rbegin(); it != comps.rend() && depth < MaxDepth; ++it, ++depth)
+          id = Table.getChild(id, *it);
+        if (comps.size() > MaxDepth)
+          exact = false;
+        path = id;
+      }
+      break;
+    }
+
+    /* 类型转换后的字段是另一个类型中的, 只保留转换前的前缀 */
+    if (llvm::isa<llvm::BitCastOperator>(V) || llvm::isa<llvm::AddrSpaceCastOperator>(V)) {
+      comps.clear();
+      exact = false;
+      derefDone = false;
+      V = llvm::cast<llvm::Operator>(V)->getOperand(0);
+      continue;
+    }
+
+    if (auto *GEP = llvm::dyn_cast<llvm::GEPOperator>(V)) {
+      llvm::Value *Base = GEP->getPointerOperand()->stripPointerCasts();
+      bool isPointer = llvm::isa<llvm::LoadInst>(Base) || llvm::isa<llvm::Argument>(Base); // 基址是指针的值, 第一个下标为解引用
+      std::vector<std::string> gepComps;
+      bool first = true, cut = false;
+      for (auto GTI = llvm::gep_type_begin(GEP), E = llvm::gep_type_end(GEP); GTI != E; ++GTI, first = false) {
+        auto *CI = llvm::dyn_cast<llvm::ConstantInt>(GTI.getOperand());
+        if (GTI.isStruct()) {
+          gepComps.push_back("." + std::to_string(CI->getZExtValue()));
+          continue;
+        }
+        if (!CI || (first && !isPointer && !CI->isZero())) { // 变量下标或超出变量的指针运算, 之后的部分都无法确定
+          cut = true;
+          break;
+        }
+        if (first && !isPointer)
+          continue;
+        gepComps.push_back("[" + std::to_string(CI->getSExtValue()) + "]");
+      }
+      if (cut) {
+        comps.clear();
+        exact = false;
+      }
+      comps.insert(comps.end(), gepComps.rbegin(), gepComps.rend());
+      derefDone = isPointer;
+      if (isPointer)
+        exact = false;
+      V = GEP->getPointerOperand();
+      continue;
+    }
+
+    /* 通过load得到的指针访问, 即*p */
+    if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(V)) {
+      if (!derefDone)
+        comps.push_back("[0]");
+      exact = false;
+      derefDone = false;
+      V = LI->getPointerOperand();
+      continue;
+    }
+
+    break;
+  }
+
+  Table.Cache[Ptr] = std::make_pair(path, exact);
+  if (Exact)
+    *Exact = exact;
+  return path;
+}
+
+#endif /* RN_ACCESS_PATH_H */
@@ -0,0 +1,95 @@
+/*
+ * RnPass与RnDuPass共用的单个函数分析预算
+ *
+ * 指令数, 边数或耗时超出限制的函数不再做精细分析, 改为输出代价很低的概要结果,
+ * 避免个别机器生成的巨型函数拖慢整个编译. 用-fprofile-instr-use编译时, profile中冷的函数也按超出预算处理
+ */
+#ifndef RN_BUDGET_H
+#define RN_BUDGET_H
+
+#include <chrono>
+#include <string>
+
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Function.h"
+
+
+/**
+ * @brief 按模块的profile summary判断函数是否冷: 入口的执行次数不高于summary中冷的阈值
+ *
+ * @param F
+ * @param PSI 为空或模块没有profile时所有函数都不冷
+ * @return true
+ * @return false
+ */
+static inline bool isRnColdFunction(const llvm::Function &F, llvm::ProfileSummaryInfo *PSI) {
+  return PSI && PSI->hasProfileSummary() && PSI->isFunctionEntryCold(&F);
+}
+
+
+class RnBudget {
+  unsigned MaxInsts;
+  unsigned MaxEdges;
+  unsigned MaxMillis;
+  std::chrono::steady_clock::time_point Start;
+  std::string Reason;
+
+public:
+  /**
+   * @brief 各项限制为0时表示不限制
+   *
+   * @param MaxInsts 指令数
+   * @param MaxEdges 边数
+   * @param MaxMillis 耗时(毫秒)
+   */
+  RnBudget(unsigned MaxInsts, unsigned MaxEdges, unsigned MaxMillis)
+      : MaxInsts(MaxInsts), MaxEdges(MaxEdges), MaxMillis(MaxMillis) {}
+
+  /**
+   * @brief 开始分析一个函数, 先检查指令数, 给出PSI时再检查函数是否冷
+   *
+   * @param F
+   * @param PSI 为空时不检查
+   * @return true 指令数超出限制或函数冷
+   * @return false
+   */
+  bool start(const llvm::Function &F, llvm::ProfileSummaryInfo *PSI = nullptr) {
+    Start = std::chrono::steady_clock::now();
+    Reason.clear();
+
+    unsigned insts = F.getInstructionCount();
+    if (MaxInsts && insts > MaxInsts)
+      Reason = "insts=" + std::to_string(insts);
+    else if (isRnColdFunction(F, PSI)) {
+      auto count = F.getEntryCount(); // 带有cold属性的函数可能没有入口的执行次数
+      Reason = count ? "cold=" + std::to_string(count->getCount()) : "cold=attr";
+    }
+    return !Reason.empty();
+  }
+
+  /**
+   * @brief 分析过程中检查边数与耗时
+   *
+   * @param Edges 当前的边数
+   * @return true 超出限制
+   * @return false
+   */
+  bool exceeded(size_t Edges) {
+    if (!Reason.empty())
+      return true;
+
+    if (MaxEdges && Edges > MaxEdges) {
+      Reason = "edges=" + std::to_string(Edges);
+    } else if (MaxMillis) {
+      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - Start).count();
+      if (ms > MaxMillis)
+        Reason = "ms=" + std::to_string(ms);
+    }
+    return !Reason.empty();
+  }
+
+  /* 超出的是哪一项限制, 形如"insts=123456", 冷的函数为"cold=入口的执行次数", 没有执行次数时为"cold=attr" */
+  const std::string &reason() const { return Reason; }
+};
+
+#endif /* RN_BUDGET_H */
@@ -0,0 +1,154 @@
+/*
+ * 距离表: parse.py输出的mydist.cfg.phf, 基本块名字到距离的最小完美哈希表
+ *
+ * 文件可以直接mmap后查找, 不需要解析文本, 也不分配内存. 所有整数均为小端序:
+ *   头部(24字节): "RNDIST01", 键的个数N, 桶的个数B, 字符串池的大小, 保留
+ *   disp[B]:      每个桶的位移. 最高位为1时低31位直接是槽位, 否则槽位为 mix(hash(key), disp) % N
+ *   slots[N]:     每个槽位两个uint32: 键在字符串池中的偏移, 距离
+ *   pool:         以'\0'结尾的基本块名字
+ * 查找时先由 mix(hash(key), 0) % B 得到桶, 再由桶的位移得到槽位, 最后比较槽位中的键, 不在表中的名字查找失败.
+ * hash为64位的FNV-1a, 每个键只计算一次; mix把种子混入后做murmur3的fmix64, 与pyscripts/rndisttable.py一致
+ */
+#ifndef RN_DIST_TABLE_H
+#define RN_DIST_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RN_DIST_TABLE_MAGIC "RNDIST01"
+#define RN_DIST_TABLE_HEADER 24
+#define RN_DIST_TABLE_DIRECT 0x80000000U
+
+/* 只读的距离表, 各指针都指向调用者提供的内存(如mmap的文件) */
+struct rn_dist_table {
+  uint32_t num_keys;
+  uint32_t num_buckets;
+  uint32_t pool_size;
+  const uint32_t *disp;
+  const uint32_t *slots;
+  const char *pool;
+};
+
+
+/**
+ * @brief 基本块名字的64位FNV-1a哈希
+ *
+ * @param key
+ * @param len
+ * @return uint64_t
+ */
+static inline uint64_t rn_dist_hash(const char *key, size_t len) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h ^= (uint8_t)key[i];
+    h *= 0x100000001B3ULL;
+  }
+  return h;
+}
+
+
+/**
+ * @brief 把种子混入哈希值, 桶使用种子0, 槽位使用桶的位移
+ *
+ * @param h
+ * @param seed
+ * @return uint32_t
+ */
+static inline uint32_t rn_dist_mix(uint64_t h, uint32_t seed) {
+  h ^= seed * 0x9E3779B97F4A7C15ULL;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return (uint32_t)h;
+}
+
+
+static inline uint32_t rn_dist_read32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/**
+ * @brief 在内存中的表上初始化, 只检查头部与各部分的大小, 不拷贝数据
+ *
+ * 各数组按uint32_t直接访问, 因此data需要4字节对齐(mmap的地址满足), 且主机为小端序
+ *
+ * @param t
+ * @param data
+ * @param size
+ * @return int 成功时为0, 格式不正确时为-1
+ */
+static inline int rn_dist_table_init(struct rn_dist_table *t, const void *data, size_t size) {
+  const unsigned char *p = (const unsigned char *)data;
+  uint64_t need;
+
+  if (size < RN_DIST_TABLE_HEADER || memcmp(p, RN_DIST_TABLE_MAGIC, 8))
+    return -1;
+
+  t->num_keys = rn_dist_read32(p + 8);
+  t->num_buckets = rn_dist_read32(p + 12);
+  t->pool_size = rn_dist_read32(p + 16);
+
+  need = RN_DIST_TABLE_HEADER + 4ULL * t->num_buckets + 8ULL * t->num_keys + t->pool_size;
+  if (need > size || (t->num_keys && !t->num_buckets))
+    return -1;
+
+  t->disp = (const uint32_t *)(p + RN_DIST_TABLE_HEADER);
+  t->slots = t->disp + t->num_buckets;
+  t->pool = (const char *)(t->slots + 2 * (size_t)t->num_keys);
+  return 0;
+}
+
+
+/**
+ * @brief 查找基本块的距离
+ *
+ * @param t
+ * @param key 基本块名字, 形如"t.c:2"
+ * @param len
+ * @param dist 找到时写入距离
+ * @return int 找到时为1, 否则为0
+ */
+static inline int rn_dist_table_lookup(const struct rn_dist_table *t, const char *key, size_t len, uint32_t *dist) {
+  uint64_t h;
+  uint32_t d, slot, off;
+
+  if (!t->num_keys)
+    return 0;
+
+  h = rn_dist_hash(key, len);
+  d = t->disp[rn_dist_mix(h, 0) % t->num_buckets];
+  if (d & RN_DIST_TABLE_DIRECT)
+    slot = d & ~RN_DIST_TABLE_DIRECT;
+  else
+    slot = rn_dist_mix(h, d) % t->num_keys;
+  if (slot >= t->num_keys)
+    return 0;
+
+  off = t->slots[2 * slot];
+  if (off >= t->pool_size || t->pool_size - off <= len)
+    return 0;
+  if (memcmp(t->pool + off, key, len) || t->pool[off + len])
+    return 0;
+
+  *dist = t->slots[2 * slot + 1];
+  return 1;
+}
+
+
+/**
+ * @brief 第i个槽位中的基本块名字, 用于遍历表中所有的键
+ *
+ * @param t
+ * @param i 小于num_keys
+ * @return const char* 以'\0'结尾
+ */
+static inline const char *rn_dist_table_key(const struct rn_dist_table *t, uint32_t i) {
+  return t->pool + t->slots[2 * i];
+}
+
+#endif /* RN_DIST_TABLE_H */
@@ -0,0 +1,232 @@
+/*
+ * RnPass与RnDuPass共用的输出工具
+ *
+ * 开启压缩时, 所有输出文件都经过zlib流式压缩为gzip格式, 文件名追加".gz",
+ * python的gzip模块可以直接边读边解压
+ *
+ * 开启打包时, 一个模块的所有图写入同一个.rnpack文件, 格式为:
+ *   [图1][图2]...[索引][尾部]
+ *   索引每行为 "类型\t文件名\t函数名\t偏移\t长度\t编码\n", 编码为raw或gz
+ *   尾部固定24字节: "RNPACK01" + 索引偏移(uint64, 小端) + 索引长度(uint64, 小端)
+ * 读取时先读尾部和索引, 再按偏移只读取需要的那一个函数的图
+ */
+#ifndef RN_OUTPUT_H
+#define RN_OUTPUT_H
+
+#include <memory>
+#include <string>
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifdef RN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+
+namespace llvm {
+
+#ifdef RN_HAVE_ZLIB
+  /**
+   * @brief 经过zlib流式压缩后写入下层流的raw_ostream, 输出为gzip格式
+   *
+   */
+  class raw_gz_ostream : public raw_ostream {
+    std::unique_ptr<raw_fd_ostream> File; // 直接写文件时持有的文件流
+    raw_ostream &OS;
+    z_stream Strm;
+    bool Inited = false; // deflateInit2是否成功
+    bool Failed = false; // 打开文件, 初始化zlib或压缩失败, 之后的数据都丢弃
+    uint64_t Pos = 0;
+    char Chunk[1 << 16];
+
+    /**
+     * @brief 把缓冲区中的数据交给zlib压缩, 并将压缩结果写入下层流
+     *
+     * @param Ptr
+     * @param Size
+     * @param Flush Z_NO_FLUSH或Z_FINISH
+     */
+    void deflateChunk(const char *Ptr, size_t Size, int Flush) {
+      Strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(Ptr));
+      Strm.avail_in = Size;
+      do {
+        Strm.next_out = reinterpret_cast<Bytef *>(Chunk);
+        Strm.avail_out = sizeof(Chunk);
+        if (deflate(&Strm, Flush) == Z_STREAM_ERROR) {
+          Failed = true;
+          return;
+        }
+        OS.write(Chunk, sizeof(Chunk) - Strm.avail_out);
+      } while (Strm.avail_out == 0);
+    }
+
+    /* 下层的文件没有打开或写入出错时不再向其中写入, 否则raw_fd_ostream会断言失败或report_fatal_error */
+    bool usable() const { return !Failed && !(File && File->has_error()); }
+
+    void write_impl(const char *Ptr, size_t Size) override {
+      if (usable())
+        deflateChunk(Ptr, Size, Z_NO_FLUSH);
+      Pos += Size;
+    }
+
+    uint64_t current_pos() const override { return Pos; }
+
+    void init(int Level) {
+      Strm.zalloc = Z_NULL;
+      Strm.zfree = Z_NULL;
+      Strm.opaque = Z_NULL;
+      Inited = deflateInit2(&Strm, Level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK; // windowBits + 16: gzip格式
+      Failed = !Inited;
+    }
+
+  public:
+    raw_gz_ostream(StringRef Filename, std::error_code &EC, sys::fs::OpenFlags Flags, int Level = Z_DEFAULT_COMPRESSION)
+        : File(new raw_fd_ostream(Filename, EC, Flags)), OS(*File) {
+      if (EC) {
+        Failed = true;
+        return;
+      }
+      init(Level);
+    }
+
+    explicit raw_gz_ostream(raw_ostream &Out, int Level = Z_DEFAULT_COMPRESSION)
+        : OS(Out) {
+      init(Level);
+    }
+
+    ~raw_gz_ostream() override {
+      flush();
+      if (usable())
+        deflateChunk(nullptr, 0, Z_FINISH);
+      if (Inited)
+        deflateEnd(&Strm);
+    }
+  };
+#endif /* RN_HAVE_ZLIB */
+
+} // namespace llvm
+
+
+/**
+ * @brief 打开输出文件, 开启压缩时文件名追加".gz"并经过zlib压缩写入
+ *
+ * @param Path
+ * @param Compress
+ * @param EC
+ * @param Flags
+ * @return std::unique_ptr<llvm::raw_ostream>
+ */
+static inline std::unique_ptr<llvm::raw_ostream> openRnOutput(const std::string &Path, bool Compress, std::error_code &EC,
+                                                              llvm::sys::fs::OpenFlags Flags = llvm::sys::fs::F_None) {
+#ifdef RN_HAVE_ZLIB
+  if (Compress)
+    return std::unique_ptr<llvm::raw_ostream>(new llvm::raw_gz_ostream(Path + ".gz", EC, Flags));
+#else
+  if (Compress)
+    llvm::errs() << "Built without zlib, writing uncompressed: " << Path << "\n";
+#endif
+  return std::unique_ptr<llvm::raw_ostream>(new llvm::raw_fd_ostream(Path, EC, Flags));
+}
+
+
+/**
+ * @brief 判断输出文件(或其压缩后的文件)是否已经存在
+ *
+ * @param Path
+ * @return true
+ * @return false
+ */
+static inline bool existsRnOutput(const std::string &Path) {
+  return llvm::sys::fs::exists(Path) || llvm::sys::fs::exists(Path + ".gz");
+}
+
+
+/**
+ * @brief 获取函数所在的源文件名(不含路径), 作为打包索引的键, 与基本块名字中的文件名一致
+ *
+ * @param F
+ * @return std::string
+ */
+static inline std::string getRnFuncFile(const llvm::Function &F) {
+  std::string filename;
+  if (llvm::DISubprogram *SP = F.getSubprogram())
+    filename = SP->getFilename().str();
+  if (filename.empty())
+    filename = F.getParent()->getSourceFileName();
+
+  std::size_t found = filename.find_last_of("/\\");
+  if (found != std::string::npos)
+    filename = filename.substr(found + 1);
+  return filename;
+}
+
+
+/**
+ * @brief 把一个模块的所有图写入同一个打包文件, 析构时写入索引和尾部
+ *
+ */
+class RnPackWriter {
+  std::error_code EC;
+  llvm::raw_fd_ostream OS;
+  bool Compress;
+  uint64_t Offset = 0;
+  std::string Index;
+
+public:
+  RnPackWriter(const std::string &Path, bool Compress)
+      : OS(Path, EC, llvm::sys::fs::F_None), Compress(Compress) {
+    if (EC)
+      llvm::errs() << "Could not open pack file: " << Path << "\n";
+  }
+
+  /**
+   * @brief 写入一个图, 开启压缩时每个图单独压缩, 保证可以随机读取
+   *
+   * @param Kind 图的类型: cfg, dfg, dfg-origin
+   * @param File 函数所在的文件名
+   * @param Func 函数名
+   * @param Data 图的内容
+   */
+  void add(llvm::StringRef Kind, llvm::StringRef File, llvm::StringRef Func, llvm::StringRef Data) {
+    if (EC)
+      return;
+
+    std::string Buf;
+    llvm::StringRef Member = Data;
+    const char *Enc = "raw";
+#ifdef RN_HAVE_ZLIB
+    if (Compress) {
+      llvm::raw_string_ostream BufOS(Buf);
+      {
+        llvm::raw_gz_ostream GzOS(BufOS);
+        GzOS << Data;
+      }
+      BufOS.flush();
+      Member = Buf;
+      Enc = "gz";
+    }
+#endif
+
+    OS << Member;
+    Index += (Kind + "\t" + File + "\t" + Func + "\t" + std::to_string(Offset) + "\t" + std::to_string(Member.size()) + "\t" + Enc + "\n").str();
+    Offset += Member.size();
+  }
+
+  ~RnPackWriter() {
+    if (EC)
+      return;
+
+    char Footer[24] = {'R', 'N', 'P', 'A', 'C', 'K', '0', '1'};
+    llvm::support::endian::write64le(Footer + 8, Offset);
+    llvm::support::endian::write64le(Footer + 16, Index.size());
+    OS << Index;
+    OS.write(Footer, sizeof(Footer));
+  }
+};
+
+#endif /* RN_OUTPUT_H */
@@ -0,0 +1,225 @@
+/*
+ * RnPass与RnDuPass共用的目标函数筛选
+ *
+ * 读取污点源文件("文件名:行号"每行一个), 以包含污点源的函数为起点, 在模块的调用图上
+ * 分别沿调用者方向(前向分析)和被调用者方向(后向分析)搜索, 只有调用距离不超过限制的函数才需要输出图.
+ * 间接调用按函数类型在签名索引中查找候选的被调用函数
+ */
+#ifndef RN_TARGET_H
+#define RN_TARGET_H
+
+#include <fstream>
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Module.h"
+
+
+/* 调用图: <函数, 其调用的函数> 与 <函数, 调用它的函数> */
+typedef std::map<const llvm::Function *, std::set<const llvm::Function *>> RnCallMap;
+
+/* 间接调用的签名索引: <函数类型, 地址被获取的有定义的函数> */
+typedef llvm::DenseMap<llvm::FunctionType *, std::vector<const llvm::Function *>> RnSigIndex;
+
+
+/**
+ * @brief 读取污点源文件
+ *
+ * @param Path
+ * @param Taints
+ * @return true 读取成功
+ * @return false 读取失败
+ */
+static inline bool readRnTaints(const std::string &Path, std::set<std::string> &Taints) {
+  std::ifstream in(Path);
+  if (!in)
+    return false;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (!line.empty())
+      Taints.insert(line);
+  }
+  return true;
+}
+
+
+/**
+ * @brief 构建间接调用的签名索引. 只有地址被获取的函数才可能通过函数指针调用, 没有定义的函数无法分析, 都不加入
+ *
+ * @param M
+ * @param Index
+ */
+static inline void buildRnSigIndex(llvm::Module &M, RnSigIndex &Index) {
+  for (auto &F : M) {
+    if (!F.isDeclaration() && F.hasAddressTaken())
+      Index[F.getFunctionType()].push_back(&F);
+  }
+}
+
+
+/**
+ * @brief 获取调用点可能调用的函数: 直接调用时为被调用的函数, 间接调用时为签名索引中类型相同的函数
+ *
+ * @param CB
+ * @param Index 为空时不解析间接调用
+ * @param MaxFanout 间接调用的候选超过这个数量时无法确定调用的是哪个, 不加入任何边(0: 不限制)
+ * @param Callees
+ */
+static inline void getRnCallees(const llvm::CallBase &CB, const RnSigIndex *Index, unsigned MaxFanout,
+                                llvm::SmallVectorImpl<const llvm::Function *> &Callees) {
+  Callees.clear();
+  if (const llvm::Function *CalledF = CB.getCalledFunction()) {
+    Callees.push_back(CalledF);
+    return;
+  }
+  if (!Index || !CB.isIndirectCall())
+    return;
+
+  auto it = Index->find(CB.getFunctionType());
+  if (it == Index->end() || (MaxFanout && it->second.size() > MaxFanout))
+    return;
+  Callees.append(it->second.begin(), it->second.end());
+}
+
+
+/**
+ * @brief 构建模块内的调用图, 只记录有定义的函数之间的调用
+ *
+ * @param M
+ * @param Callees
+ * @param Callers
+ * @param Index 不为空时包括间接调用的候选
+ * @param MaxFanout
+ */
+static inline void buildRnCallGraph(llvm::Module &M, RnCallMap &Callees, RnCallMap &Callers, const RnSigIndex *Index = nullptr,
+                                    unsigned MaxFanout = 0) {
+  llvm::SmallVector<const llvm::Function *, 8> calledFs;
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      for (auto &I : BB) {
+        auto *CB = llvm::dyn_cast<llvm::CallBase>(&I);
+        if (!CB)
+          continue;
+
+        getRnCallees(*CB, Index, MaxFanout, calledFs);
+        for (const llvm::Function *CalledF : calledFs) {
+          if (CalledF->isDeclaration())
+            continue;
+          Callees[&F].insert(CalledF);
+          Callers[CalledF].insert(&F);
+        }
+      }
+    }
+  }
+}
+
+
+/**
+ * @brief 从起点函数出发, 沿调用图的一个方向广度优先搜索, 记录调用距离不超过MaxDist的函数
+ *
+ * @param Seeds
+ * @param Edges
+ * @param MaxDist 小于0时不限制距离
+ * @param Result
+ */
+static inline void searchRnCallMap(const std::set<const llvm::Function *> &Seeds, const RnCallMap &Edges, int MaxDist,
+                                   std::set<const llvm::Function *> &Result) {
+  std::map<const llvm::Function *, int> dist;
+  std::queue<const llvm::Function *> q;
+
+  for (auto *F : Seeds) {
+    dist[F] = 0;
+    q.push(F);
+  }
+
+  while (!q.empty()) {
+    const llvm::Function *F = q.front();
+    q.pop();
+    Result.insert(F);
+
+    if (MaxDist >= 0 && dist[F] >= MaxDist)
+      continue;
+
+    auto it = Edges.find(F);
+    if (it == Edges.end())
+      continue;
+
+    for (auto *Next : it->second) {
+      if (dist.count(Next))
+        continue;
+      dist[Next] = dist[F] + 1;
+      q.push(Next);
+    }
+  }
+}
+
+
+/**
+ * @brief 获取需要输出图的函数: 起点函数, 以及调用距离不超过MaxDist的调用者和被调用者
+ *
+ * @param M
+ * @param Seeds 包含污点源的函数
+ * @param MaxDist 小于0时不限制距离
+ * @param Result
+ * @param Index 不为空时包括间接调用的候选
+ * @param MaxFanout
+ */
+static inline void getRnTargetFuncs(llvm::Module &M, const std::set<const llvm::Function *> &Seeds, int MaxDist,
+                                    std::set<const llvm::Function *> &Result, const RnSigIndex *Index = nullptr,
+                                    unsigned MaxFanout = 0) {
+  RnCallMap callees, callers;
+  buildRnCallGraph(M, callees, callers, Index, MaxFanout);
+
+  searchRnCallMap(Seeds, callers, MaxDist, Result); // 前向分析沿调用者方向传播
+  searchRnCallMap(Seeds, callees, MaxDist, Result); // 后向分析沿被调用者方向传播
+}
+
+
+/**
+ * @brief 获取需要输出图的函数: 包含污点源的函数, 以及调用距离不超过MaxDist的调用者和被调用者
+ *
+ * @tparam LocFn 获取指令位置"文件名:行号"的函数, 与各Pass中基本块名字的规则一致
+ * @param M
+ * @param Taints
+ * @param MaxDist 小于0时不限制距离
+ * @param GetLoc
+ * @param Result
+ * @param Index 不为空时包括间接调用的候选
+ * @param MaxFanout
+ */
+template <typename LocFn>
+static void getRnTargetFuncs(llvm::Module &M, const std::set<std::string> &Taints, int MaxDist, LocFn GetLoc,
+                             std::set<const llvm::Function *> &Result, const RnSigIndex *Index = nullptr,
+                             unsigned MaxFanout = 0) {
+  std::set<const llvm::Function *> seeds;
+  for (auto &F : M) {
+    bool hasTaint = false;
+    for (auto &BB : F) {
+      for (auto &I : BB) {
+        if (Taints.count(GetLoc(I))) {
+          hasTaint = true;
+          break;
+        }
+      }
+      if (hasTaint)
+        break;
+    }
+    if (hasTaint)
+      seeds.insert(&F);
+  }
+
+  getRnTargetFuncs(M, seeds, MaxDist, Result, Index, MaxFanout);
+}
+
+#endif /* RN_TARGET_H */
@@ -0,0 +1,124 @@
+/*
+ * RnPass与RnDuPass共用的后台写文件线程
+ *
+ * 分析线程只负责把每个函数的图/json序列化到内存中, 然后交给后台线程写入磁盘(包括压缩和打包),
+ * 不必等待输出完成就可以继续分析下一个函数. 队列有长度上限, 写入跟不上时分析线程才会等待,
+ * 避免内存无限增长. 队列长度为0时不创建线程, 直接在调用线程上写入
+ */
+#ifndef RN_WRITER_H
+#define RN_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "RnOutput.h"
+
+
+class RnAsyncWriter {
+  std::deque<std::function<void()>> Jobs;
+  unsigned Capacity;
+  bool Done = false;
+  std::mutex Lock;
+  std::condition_variable NotEmpty, NotFull;
+  std::thread Worker;
+  std::vector<std::string> Failed; // 打开失败的文件, 由调用线程在finish()中统一报告
+
+  /* 后台线程: 按提交顺序依次执行写入任务, 直到finish()且队列为空 */
+  void run() {
+    for (;;) {
+      std::function<void()> Job;
+      {
+        std::unique_lock<std::mutex> L(Lock);
+        NotEmpty.wait(L, [this] { return Done || !Jobs.empty(); });
+        if (Jobs.empty())
+          return;
+        Job = std::move(Jobs.front());
+        Jobs.pop_front();
+      }
+      NotFull.notify_one();
+      Job();
+    }
+  }
+
+public:
+  /**
+   * @brief
+   *
+   * @param Capacity 队列中最多等待写入的任务数, 为0时同步写入
+   */
+  explicit RnAsyncWriter(unsigned Capacity)
+      : Capacity(Capacity) {
+    if (Capacity)
+      Worker = std::thread(&RnAsyncWriter::run, this);
+  }
+
+  ~RnAsyncWriter() { finish(); }
+
+  /**
+   * @brief 提交一个写入任务, 队列已满时等待. 任务在后台线程上按提交顺序执行
+   *
+   * @param Job 任务中不能再访问IR, 只能使用已经序列化好的数据
+   */
+  void post(std::function<void()> Job) {
+    if (!Worker.joinable()) {
+      Job();
+      return;
+    }
+
+    {
+      std::unique_lock<std::mutex> L(Lock);
+      NotFull.wait(L, [this] { return Jobs.size() < Capacity; });
+      Jobs.push_back(std::move(Job));
+    }
+    NotEmpty.notify_one();
+  }
+
+  /**
+   * @brief 把序列化好的内容写入文件, 文件的打开与压缩都在后台线程上进行
+   *
+   * @param Path
+   * @param Data
+   * @param Compress
+   * @param Flags
+   */
+  void write(std::string Path, std::string Data, bool Compress, llvm::sys::fs::OpenFlags Flags = llvm::sys::fs::F_None) {
+    post([this, Path = std::move(Path), Data = std::move(Data), Compress, Flags]() {
+      std::error_code EC;
+      std::unique_ptr<llvm::raw_ostream> OS = openRnOutput(Path, Compress, EC, Flags);
+      if (EC) {
+        std::lock_guard<std::mutex> L(Lock);
+        Failed.push_back(Path);
+        return;
+      }
+      *OS << Data;
+    });
+  }
+
+  /**
+   * @brief 等待所有任务写完并结束后台线程, 报告写入失败的文件
+   *
+   */
+  void finish() {
+    {
+      std::lock_guard<std::mutex> L(Lock);
+      Done = true;
+    }
+    NotEmpty.notify_one();
+    if (Worker.joinable())
+      Worker.join();
+
+    for (auto &Path : Failed)
+      llvm::errs() << "Could not write file: " << Path << "\n";
+    Failed.clear();
+  }
+};
+
+#endif /* RN_WRITER_H */
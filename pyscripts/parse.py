@@ -8,6 +8,7 @@ Description: Hi, say something
 import argparse
 import copy
 import functools
+import gzip
 import heapq
 import json
 import os
@@ -20,8 +21,19 @@ from statistics import mean
 import networkx as nx
 import pydot
 
+from rndisttable import writeDistTable
+from rnpack import RnPackDir
+
+try:
+    import _rndist  # build/rndist中的扩展模块, 需要在PYTHONPATH中
+except ImportError:
+    _rndist = None
+
 # Global
 DU_VAR_DICT = dict()  # <行, <def/use, {变量}>>
+DU_EDGE_DICT = dict()  # <def所在的行, <use所在的行, {变量}>>, 来自RnDuPass -rndu-rd输出的duEdge.json
+DU_EDGE_BACK_DICT = dict()  # <use所在的行, <def所在的行, {变量}>>
+PATH_ANCESTORS = dict()  # <访问路径, {其上级的路径}>, 来自RnDuPass -rndu-field-paths输出的accessPath.json
 BB_LINE_DICT = dict()  # <bb名, 它所包含的所有行>
 BB_FUNC_DICT = dict()  # <bb名, 它所在的函数>
 FUNC_ENTRY_DICT = dict()  # <函数名, 它的入口BB名字>
@@ -31,6 +43,11 @@ LINE_CALLS_PRE_DICT = dict()  # <调用的函数, <行, <形参, {实参}>>>
 LINE_CALLS_BACK_DICT = dict()  # <行, <调用的函数, <形参, {实参}>>>
 LINE_BB_DICT = dict()  # <行, 其所在基本块>
 MAX_LINE_DICT = dict()  # <文件名, 其最大行数>
+CFG_PACKS = None  # dot目录下打包输出的cfg, 没有.rnpack文件时为空
+WEIGHTED = False  # 是否按cfg边的rncost属性计算加权距离
+CFG_CACHE = dict()  # <(文件名, 函数名), (cfg, networkx图, 节点)>, 没有输出cfg的函数为None, 批量计算时各组污点源共用
+DIST_CACHE = dict()  # <(文件名, 函数名, 节点名, 是否反向), <节点名, 距离>>
+NATIVE = None  # _rndist.Engine, 开启-n时getNodeName与cfgDistances由其计算
 
 MAX_CONCERN_DIST = 63
 
@@ -75,6 +92,33 @@ def myCmp(x, y):
     return 0
 
 
+def overlaps(a: set, b: set) -> bool:
+    """两个变量集合是否可能访问同一处内存: 有相同的变量, 或一方中的访问路径是另一方中路径的上级(前缀), 如s与s.1[2]
+
+    Parameters
+    ----------
+    a : set
+        变量或访问路径的集合
+    b : set
+        变量或访问路径的集合
+
+    Returns
+    -------
+    bool
+        是否重叠, 没有accessPath.json时与a & b相同
+    """
+    if a & b:
+        return True
+    if not PATH_ANCESTORS:
+        return False
+    for x, y in ((a, b), (b, a)):
+        for path in x:
+            ancestors = PATH_ANCESTORS.get(path)
+            if ancestors and not ancestors.isdisjoint(y):
+                return True
+    return False
+
+
 def isPreTainted(bbname: str, preSet: set):
     """查看该基本块是否被前向污染了
 
@@ -105,7 +149,7 @@ def isPreTainted(bbname: str, preSet: set):
 
     for bbline in BB_LINE_DICT[bbname]:
         try:
-            if DU_VAR_DICT[bbline]["def"] & preSet:
+            if overlaps(DU_VAR_DICT[bbline]["def"], preSet):
                 isTainted = True
                 bbDuSet = bbDuSet - DU_VAR_DICT[bbline]["def"] | DU_VAR_DICT[bbline]["use"]
         except KeyError:
@@ -146,7 +190,7 @@ def isBackTainted(bbname: str, backSet: set, backQueue: Queue, distance: int):
                 targetLabel = FUNC_ENTRY_DICT[calledF]
                 nBackSet = backSet.copy()
                 for param, arguments in pas.items():
-                    if nBackSet & arguments:
+                    if overlaps(nBackSet, arguments):
                         nBackSet -= arguments
                         nBackSet.add(param)
                 if len(nBackSet) > 0:  # 如果更新后的变量集合为空的话, 加入队列也没有意义, 跳过
@@ -156,7 +200,7 @@ def isBackTainted(bbname: str, backSet: set, backQueue: Queue, distance: int):
 
         # 根据每行的定义使用情况更新变量集合
         try:
-            if DU_VAR_DICT[bbline]["use"] & bbDuSet:
+            if overlaps(DU_VAR_DICT[bbline]["use"], bbDuSet):
                 isTainted = True
                 bbDuSet = bbDuSet - DU_VAR_DICT[bbline]["use"] | DU_VAR_DICT[bbline]["def"]
         except KeyError:
@@ -165,6 +209,67 @@ def isBackTainted(bbname: str, backSet: set, backQueue: Queue, distance: int):
     return isTainted, bbDuSet
 
 
+def rdSlice(loc: str, varSet: set, forward: bool) -> dict:
+    """沿到达定值分析得到的def行->use行的边, 获取与loc处的变量相关的所有行及这些行上受污染的变量
+
+    Parameters
+    ----------
+    loc : str
+        文件名:行数
+    varSet : set
+        loc处受污染的变量
+    forward : bool
+        False: 到达loc处use的def所在的行, 并递归地查找到达这些行的use的def, 用于前向分析
+        True: loc处的def能到达的use所在的行, 并递归地查找这些行的def能到达的use, 用于后向分析
+
+    Returns
+    -------
+    dict
+        <相关的行(包括loc), 受污染的变量>: 经过的边上的变量, 以及从该行继续查找的变量(前向为该行的use, 后向为def)
+    """
+    edges = DU_EDGE_DICT if forward else DU_EDGE_BACK_DICT
+    kind = "def" if forward else "use"
+    lines = {loc: set(varSet)}
+    stack = [(loc, varSet)]
+    while stack:
+        line, vars = stack.pop()
+        for nline, nvars in edges.get(line, dict()).items():
+            if not overlaps(nvars, vars):
+                continue
+            if nline in lines:
+                lines[nline] |= set(nvars)
+                continue
+            kindVars = DU_VAR_DICT.get(nline, dict()).get(kind, set())
+            lines[nline] = set(nvars) | kindVars
+            stack.append((nline, kindVars))
+    return lines
+
+
+def sliceTainted(rdLines: dict, bbname: str, bbDuSet: set):
+    """有到达定值分析的结果时, 按切片判断基本块是否受污染, 传给下一宽度以及调用者与被调用者的变量也来自切片
+
+    Parameters
+    ----------
+    rdLines : dict
+        rdSlice的结果
+    bbname : str
+        基本块名称
+    bbDuSet : set
+        基本块不在切片中时传给下一宽度的变量
+
+    Returns
+    -------
+    bool
+        是否受污染, 即基本块中有切片中的行
+    set
+        受污染时为这些行上受污染的变量的并集, 否则为bbDuSet
+    """
+    vars = [rdLines[line] for line in BB_LINE_DICT[bbname] if line in rdLines]
+    if not vars:
+        return False, bbDuSet
+    return True, set().union(*vars)
+
+
 def getbbPreTainted(loc: str, preSet: set):
     """根据行数获取基本块, 并更新变量污染信息
 
@@ -197,7 +302,7 @@ def getbbPreTainted(loc: str, preSet: set):
         loc = filename + ":" + str(line)
 
         try:
-            if DU_VAR_DICT[loc]["def"] & preSet:
+            if overlaps(DU_VAR_DICT[loc]["def"], preSet):
                 preSet = preSet - DU_VAR_DICT[loc]["def"] | DU_VAR_DICT[loc]["use"]
         except KeyError:
             continue  # 该行没有定义-使用关系, 跳过
@@ -238,7 +343,7 @@ def getbbBackTainted(loc: str, backSet: set):
             break  # 如果顺序遍历到文件末尾了, 跳出循环
 
         try:
-            if DU_VAR_DICT[loc]["use"] & backSet:
+            if overlaps(DU_VAR_DICT[loc]["use"], backSet):
                 backSet = backSet - DU_VAR_DICT[loc]["use"] | DU_VAR_DICT[loc]["def"]
         except KeyError:
             continue  # 该行没有定义使用关系
@@ -246,7 +351,70 @@ def getbbBackTainted(loc: str, backSet: set):
     return bbname
 
 
-def getNodeName(nodes, nodeLabel) -> str:
+def openArtifact(path: str):
+    """打开RnDuPass的输出文件, 文件不存在时尝试边读边解压压缩后的 path + ".gz"
+
+    Parameters
+    ----------
+    path : str
+        未压缩时的文件路径
+
+    Returns
+    -------
+    file object
+        文本模式的文件对象
+    """
+    if not os.path.exists(path) and os.path.exists(path + ".gz"):
+        return gzip.open(path + ".gz", mode="rt")
+    return open(path)
+
+
+def loadDot(path: str):
+    """读取dot文件, 支持压缩后的 path + ".gz"
+
+    Parameters
+    ----------
+    path : str
+        未压缩时的dot文件路径
+
+    Returns
+    -------
+    pydot.Dot
+        dot文件中的第一个图
+    """
+    with openArtifact(path) as f:
+        return pydot.graph_from_dot_data(f.read())[0]
+
+
+def loadCfg(dotPath: str, func: str, bbname: str):
+    """读取函数的cfg, 优先从打包文件中按(文件名, 函数名)读取, 避免同名函数互相覆盖
+
+    Parameters
+    ----------
+    dotPath : str
+        存储dot文件的目录
+    func : str
+        函数名
+    bbname : str
+        函数中的基本块名字, 形如filename:line, 用于获得函数所在的文件名
+
+    Returns
+    -------
+    pydot.Dot
+        函数的cfg, 没有输出该函数的cfg时(如RnDuPass开启了-rndu-taint)为None
+    """
+    if CFG_PACKS:
+        try:
+            return pydot.graph_from_dot_data(CFG_PACKS.read("cfg", bbname.split(":")[0], func))[0]
+        except KeyError:
+            return None
+    path = dotPath + "/cfg." + func + ".dot"
+    if not os.path.exists(path) and not os.path.exists(path + ".gz"):
+        return None
+    return loadDot(path)
+
+
+def getNodeName(nodes, nodeLabel, key: tuple = None) -> str:
     """遍历nodes, 获取nodeLabel的name, 形如Node0x56372e651a90
 
     Parameters
@@ -255,6 +423,8 @@ def getNodeName(nodes, nodeLabel) -> str:
         _description_
     nodeLabel : _type_
         _description_
+    key : tuple, optional
+        getCfg返回的缓存的键, 开启-n时按键在_rndist.Engine中查找, 不再遍历nodes
 
     Returns
     -------
@@ -265,35 +435,122 @@ def getNodeName(nodes, nodeLabel) -> str:
     -----
     _description_
     """
+    if NATIVE and key is not None:
+        return NATIVE.getNodeName(key[0], key[1], nodeLabel)
+
     for node in nodes:
         if node.get("label") == "\"{" + nodeLabel + ":}\"":
             return node.obj_dict["name"]
     return ""
 
 
-def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
-    """计算各基本块的适应度
+def edgeCost(u, v, d) -> int:
+    """cfg边的代价, 即RnDuPass开启-rndu-weighted时输出的rncost属性, 没有时为1
 
     Parameters
     ----------
-    path : str
-        _description_
-    tSrcsFile : str
-        _description_
+    u : str
+        起点
+    v : str
+        终点
+    d : dict
+        from_pydot得到的是多重图, d为<边的key, 边的属性>, 属性值为字符串
 
-    Notes
-    -----
-    _description_
+    Returns
+    -------
+    int
+        平行边中最小的代价
     """
-    tSrcs = dict()
-    distDict = dict()  # <bb名, 适应度数组>
-    resDict = dict()  # <bb名, 适应度>
-    index = 0  # 下标
+    return min(int(attr.get("rncost", 1)) for attr in d.values())
+
+
+def getCfg(dotPath: str, func: str, bbname: str):
+    """读取函数的cfg并转换为networkx图, 结果缓存, 同一函数只读取一次
+
+    Parameters
+    ----------
+    dotPath : str
+        存储dot文件的目录
+    func : str
+        函数名
+    bbname : str
+        函数中的基本块名字, 形如filename:line
+
+    Returns
+    -------
+    tuple
+        (缓存的键, pydot.Dot, nx.MultiDiGraph, 节点列表), 没有该函数的cfg时为None
+    """
+    key = (bbname.split(":")[0] if CFG_PACKS else "", func)  # 不打包时cfg只按函数名区分
+    if key not in CFG_CACHE:
+        cfgdot = loadCfg(dotPath, func, bbname)
+        CFG_CACHE[key] = None if cfgdot is None else (cfgdot, nx.drawing.nx_pydot.from_pydot(cfgdot), cfgdot.get_nodes())
+    if CFG_CACHE[key] is None:
+        return None
+    return (key,) + CFG_CACHE[key]
+
+
+def cfgDistances(key: tuple, cfgnx, node: str, reverse: bool) -> dict:
+    """cfg中所有节点到node(reverse为True)或node到所有节点的最短距离, 开启加权时按edgeCost计算, 结果缓存.
+    开启-n时由_rndist.Engine计算, 结果相同
+
+    Parameters
+    ----------
+    key : tuple
+        getCfg返回的缓存的键
+    cfgnx : nx.MultiDiGraph
+        函数的cfg
+    node : str
+        节点名
+    reverse : bool
+        True: 其他节点到node的距离, 用于前向分析; False: node到其他节点的距离, 用于后向分析
+
+    Returns
+    -------
+    dict
+        <节点名, 最短距离>, 不可达的节点不在其中
+    """
+    dkey = key + (node, reverse)
+    if dkey not in DIST_CACHE:
+        g = cfgnx.reverse(copy=False) if reverse else cfgnx
+        if NATIVE:
+            DIST_CACHE[dkey] = NATIVE.cfgDistances(key[0], key[1], node, reverse)
+        elif WEIGHTED:
+            DIST_CACHE[dkey] = nx.single_source_dijkstra_path_length(g, node, weight=edgeCost)
+        else:
+            DIST_CACHE[dkey] = nx.single_source_shortest_path_length(g, node)
+    return DIST_CACHE[dkey]
+
+
+def loadArtifacts(path: str, dotPath: str, weighted: bool = False, native: bool = False):
+    """读取RnDuPass的输出, 批量计算时只读取一次
+
+    Parameters
+    ----------
+    path : str
+        存储json, txt等文件的目录
+    dotPath : str
+        存储dot文件的目录
+    weighted : bool, optional
+        是否按cfg边的rncost属性计算加权距离, 此时MAX_CONCERN_DIST也按加权距离比较
+    native : bool, optional
+        是否同时用扩展模块_rndist读取, getNodeName与cfgDistances改为在C++中计算
+    """
+    global DU_VAR_DICT, DU_EDGE_DICT, DU_EDGE_BACK_DICT, PATH_ANCESTORS, BB_LINE_DICT, BB_FUNC_DICT, FUNC_ENTRY_DICT, FUNC_PARAM_DICT, CALL_ARGS_DICT
+    global LINE_CALLS_PRE_DICT, LINE_CALLS_BACK_DICT, LINE_BB_DICT, MAX_LINE_DICT, CFG_PACKS, WEIGHTED, NATIVE
+
+    WEIGHTED = weighted
 
-    global DU_VAR_DICT, BB_LINE_DICT, BB_FUNC_DICT, FUNC_ENTRY_DICT, FUNC_PARAM_DICT, CALL_ARGS_DICT
-    global LINE_CALLS_PRE_DICT, LINE_CALLS_BACK_DICT, LINE_BB_DICT, MAX_LINE_DICT
+    if native:
+        if _rndist is None:
+            sys.exit("Could not import _rndist, add build/rndist to PYTHONPATH")
+        NATIVE = _rndist.Engine(weighted=weighted, maxDist=MAX_CONCERN_DIST)
+        if not NATIVE.load(path, dotPath):
+            sys.exit("_rndist could not load " + path)
 
-    with open(path + "/duVar.json") as f:  # 读取定义使用关系的json文件
+    CFG_PACKS = RnPackDir(dotPath)
+
+    with openArtifact(path + "/duVar.json") as f:  # 读取定义使用关系的json文件
         DU_VAR_DICT = json.load(f)
 
         for k, v in DU_VAR_DICT.items():
@@ -304,23 +561,41 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
             if "use" in v.keys():
                 v["use"] = set(v["use"])
 
-    with open(path + "/bbLine.json") as f:  # 读取基本块和它所有报行的行的json文件
+    if os.path.exists(path + "/duEdge.json") or os.path.exists(path + "/duEdge.json.gz"):  # 开启-rndu-rd时才有
+        with openArtifact(path + "/duEdge.json") as f:
+            DU_EDGE_DICT = json.load(f)
+        for dLine, uDict in DU_EDGE_DICT.items():
+            for uLine, vars in uDict.items():
+                uDict[uLine] = set(vars)
+                DU_EDGE_BACK_DICT.setdefault(uLine, dict())[dLine] = uDict[uLine]
+
+    if os.path.exists(path + "/accessPath.json") or os.path.exists(path + "/accessPath.json.gz"):  # 开启-rndu-field-paths时才有
+        with openArtifact(path + "/accessPath.json") as f:
+            parents = json.load(f)  # <访问路径, 上一级路径>
+        for p in parents:
+            ancestors, q = set(), parents[p]
+            while q is not None:
+                ancestors.add(q)
+                q = parents.get(q)
+            PATH_ANCESTORS[p] = ancestors
+
+    with openArtifact(path + "/bbLine.json") as f:  # 读取基本块和它所有报行的行的json文件
         BB_LINE_DICT = json.load(f)
     for k, v in BB_LINE_DICT.items():  # 对基本块所拥有的行进行排序, 从大到小, 方便后续操作
         v.sort(key=functools.cmp_to_key(myCmp))
 
-    with open(path + "/bbFunc.json") as f:  # 该json是为了能更快地确认bb所在函数
+    with openArtifact(path + "/bbFunc.json") as f:  # 该json是为了能更快地确认bb所在函数
         BB_FUNC_DICT = json.load(f)
 
-    with open(path + "/funcEntry.json") as f:  # 该json是为了更方便地计算跨函数间的基本块距离
+    with openArtifact(path + "/funcEntry.json") as f:  # 该json是为了更方便地计算跨函数间的基本块距离
         FUNC_ENTRY_DICT = json.load(f)
         for k, v in FUNC_ENTRY_DICT.items():
             FUNC_ENTRY_DICT[k] = v.rstrip(":")
 
-    with open(path + "/funcParam.json") as f:
+    with openArtifact(path + "/funcParam.json") as f:
         FUNC_PARAM_DICT = json.load(f)
 
-    with open(path + "/callArgs.json") as f:
+    with openArtifact(path + "/callArgs.json") as f:
         CALL_ARGS_DICT = json.load(f)
 
     for line, vDict in CALL_ARGS_DICT.items():
@@ -346,12 +621,30 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
                 LINE_CALLS_PRE_DICT[func][line][param] = set(args[i])
                 LINE_CALLS_BACK_DICT[line][func][param] = set(args[i])
 
-    with open(path + "/linebb.json") as f:  # 该json存储了每一行对应的基本块
+    with openArtifact(path + "/linebb.json") as f:  # 该json存储了每一行对应的基本块
         LINE_BB_DICT = json.load(f)
 
-    with open(path + "/maxLine.json") as f:
+    with openArtifact(path + "/maxLine.json") as f:
         MAX_LINE_DICT = json.load(f)
 
+
+def computeDistances(dotPath: str, tSrcsFile: str, outPath: str):
+    """根据一组污点源计算各基本块的适应度, 需要先调用loadArtifacts
+
+    Parameters
+    ----------
+    dotPath : str
+        存储dot文件的目录
+    tSrcsFile : str
+        存储污点源信息的txt文件
+    outPath : str
+        输出mydist.cfg.txt与mydist.cfg.phf的目录
+    """
+    tSrcs = dict()
+    distDict = dict()  # <bb名, 适应度数组>
+    resDict = dict()  # <bb名, 适应度>
+    index = 0  # 下标
+
     with open(tSrcsFile) as f:
         lines = f.readlines()
         for line in lines:
@@ -391,8 +684,11 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
 
             print("Pre analyzing " + targetLabel + "..., cgDist: ", cgDist)
 
+            # 有到达定值分析的结果时, 直接沿def-use边判断基本块是否受污染以及传递的变量, 不再按行的顺序模拟
+            rdLines = rdSlice(targetLabel, preSet, False) if DU_EDGE_DICT else None
+
             # TODO: 目前遇到结构体数组会出错, 因为获取定义-使用关系时是根据指令的op获取变量名
-            # 但LLVM在遇到结构体数组时似乎不会把它当作一个op, 目前还没想到解决办法
+            # 但LLVM在遇到结构体数组时似乎不会把它当作一个op; RnDuPass开启-rndu-field-paths后按访问路径记录, 见overlaps
             try:
                 targetLabel = getbbPreTainted(targetLabel, preSet)
             except:
@@ -400,22 +696,24 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
                 continue
 
             func = BB_FUNC_DICT[targetLabel]
-            cfg = "cfg." + func + ".dot"
             pq = PriorityQueue()
 
-            cfgdot = pydot.graph_from_dot_file(dotPath + "/" + cfg)[0]
-            cfgnx = nx.drawing.nx_pydot.from_pydot(cfgdot)
-            nodes = cfgdot.get_nodes()
+            cfg = getCfg(dotPath, func, targetLabel)
+            if cfg is None:
+                continue  # 没有输出该函数的cfg, 跳过
+            key, cfgdot, cfgnx, nodes = cfg
 
-            targetName = getNodeName(nodes, targetLabel)
+            targetName = getNodeName(nodes, targetLabel, key)
 
             entryLabel = FUNC_ENTRY_DICT[func]
-            entryName = getNodeName(nodes, entryLabel)
+            entryName = getNodeName(nodes, entryLabel, key)
 
             # 若无法获取target或entry的name, 跳过
             if len(targetName) == 0 or len(entryName) == 0:
                 continue
 
+            toTarget = cfgDistances(key, cfgnx, targetName, True)
+
             # 获取以污点源为终点, 能到达它的基本块, 达成前向分析的效果
             for node in nodes:
                 nodeLabel = node.get("label").lstrip("\"{").rstrip(":}\"")
@@ -428,10 +726,10 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
                     if nodeName == targetName:
                         distance = cgDist
                     else:
-                        distance = cgDist + nx.shortest_path_length(cfgnx, nodeName, targetName)
+                        distance = cgDist + toTarget[nodeName]
                     pq.put(MyNode(distance, nodeName, nodeLabel))
-                except nx.NetworkXNoPath:
-                    pass
+                except KeyError:
+                    pass  # 无法到达, 跳过
 
             nowDist = cgDist  # nowDist用于判断当前节点与上一节点是否是同一宽度
             bbSumDuSet = set()
@@ -454,7 +752,10 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
                     # 有的基本块是LLVM自动补充的, 和源文件的位置对应不上, 分析它是否受污染的话会出错
                     # 因此这种基本块默认为没有受污染
                     try:
-                        isTainted, bbDuSet = isPreTainted(bbname, preSet)
+                        if rdLines is not None:
+                            isTainted, bbDuSet = sliceTainted(rdLines, bbname, preSet)
+                        else:
+                            isTainted, bbDuSet = isPreTainted(bbname, preSet)
                         bbSumDuSet |= bbDuSet
                     except:
                         isTainted = False
@@ -472,7 +773,9 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
                     else:
                         distDict[bbname][index] = min(distDict[bbname][index], distance)
 
-            cgDist += nx.shortest_path_length(cfgnx, entryName, targetName)
+            if entryName not in toTarget:
+                continue  # 入口无法到达污点源, 调用者也无法到达
+            cgDist += toTarget[entryName]
 
             # 如果没有函数调用了func, 证明前向分析到头了, 不需要再往队列里添加元素了
             if not func in LINE_CALLS_PRE_DICT.keys():
@@ -506,22 +809,26 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
 
             print("Back analyzing " + targetLabel + "..., cgDist: ", cgDist)
 
+            rdLines = rdSlice(targetLabel, backSet, True) if DU_EDGE_DICT else None
+
             targetLabel = getbbBackTainted(targetLabel, backSet)
 
             func = BB_FUNC_DICT[targetLabel]
-            cfg = "cfg." + func + ".dot"
             pq = PriorityQueue()
 
-            cfgdot = pydot.graph_from_dot_file(dotPath + "/" + cfg)[0]
-            cfgnx = nx.drawing.nx_pydot.from_pydot(cfgdot)
-            nodes = cfgdot.get_nodes()
+            cfg = getCfg(dotPath, func, targetLabel)
+            if cfg is None:
+                continue  # 没有输出该函数的cfg, 跳过
+            key, cfgdot, cfgnx, nodes = cfg
 
-            targetName = getNodeName(nodes, targetLabel)
+            targetName = getNodeName(nodes, targetLabel, key)
 
             # 若无法获取target的name, 跳过
             if len(targetName) == 0:
                 continue
 
+            fromTarget = cfgDistances(key, cfgnx, targetName, False)
+
             # 获取以污点源为起点, 能被它到达的基本块, 达成后向污点分析的效果
             for node in nodes:
                 nodeLabel = node.get("label").lstrip("\"{").rstrip(":}\"")
@@ -534,9 +841,9 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
                     if nodeName == targetName:
                         distance = cgDist
                     else:
-                        distance = nx.shortest_path_length(cfgnx, targetName, nodeName) + cgDist
+                        distance = fromTarget[nodeName] + cgDist
                     pq.put(MyNode(distance, nodeName, nodeLabel))
-                except nx.NetworkXNoPath:
+                except KeyError:
                     pass  # 无法到达, 跳过
 
             nowDist = cgDist
@@ -556,6 +863,8 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
                 # 因此这种基本块默认为没有受污染
                 try:
                     isTainted, bbDuSet = isBackTainted(bbname, backSet, backQueue, distance)
+                    if rdLines is not None:
+                        isTainted, bbDuSet = sliceTainted(rdLines, bbname, backSet)
                     bbSumDuSet |= bbDuSet
                 except:
                     isTainted = False
@@ -586,10 +895,90 @@ def distanceCalculation(path: str, dotPath: str, tSrcsFile: str):
         dists = [dist for dist in dists if dist != -1]
         resDict[bb] = min(dists)
 
-    with open(path + "/mydist.cfg.txt", mode="w") as f:
+    with open(outPath + "/mydist.cfg.txt", mode="w") as f:
         for bb, dist in resDict.items():
             f.write(bb + "," + str(dist) + "\n")
 
+    # 同时输出可以直接mmap查找的距离表, 使用者不必再解析文本
+    writeDistTable(outPath + "/mydist.cfg.phf", resDict)
+
+
+def distanceCalculation(path: str, dotPath: str, tSrcsFile: str, weighted: bool = False, native: bool = False):
+    """计算各基本块的适应度
+
+    Parameters
+    ----------
+    path : str
+        存储json, txt等文件的目录, 结果也输出到这里
+    dotPath : str
+        存储dot文件的目录
+    tSrcsFile : str
+        存储污点源信息的txt文件
+    weighted : bool, optional
+        是否按cfg边的rncost属性计算加权距离
+    native : bool, optional
+        是否用扩展模块_rndist计算cfg中的距离
+    """
+    loadArtifacts(path, dotPath, weighted, native)
+    computeDistances(dotPath, tSrcsFile, path)
+
+
+def readManifest(manifest: str, path: str) -> list:
+    """读取批量计算的清单: 每行为 "污点源文件 [输出目录]", 空行与#开头的行忽略.
+    相对路径相对于清单所在的目录, 没有输出目录时为 path/batch/<污点源文件名去掉扩展名>
+
+    Parameters
+    ----------
+    manifest : str
+        清单文件
+    path : str
+        存储json, txt等文件的目录
+
+    Returns
+    -------
+    list
+        [(污点源文件, 输出目录)]
+    """
+    jobs = []
+    base = os.path.dirname(os.path.abspath(manifest))
+    with open(manifest) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith("#"):
+                continue
+            tSrcsFile = os.path.join(base, fields[0])
+            if len(fields) > 1:
+                outPath = os.path.join(base, fields[1])
+            else:
+                outPath = os.path.join(path, "batch", os.path.splitext(os.path.basename(fields[0]))[0])
+            jobs.append((tSrcsFile, outPath))
+    return jobs
+
+
+def batchCalculation(path: str, dotPath: str, manifest: str, weighted: bool = False, native: bool = False):
+    """对清单中的每组污点源分别计算适应度. RnDuPass的输出只读取一次, 各函数的cfg与到污点源的距离在各组之间共用
+
+    Parameters
+    ----------
+    path : str
+        存储json, txt等文件的目录
+    dotPath : str
+        存储dot文件的目录
+    manifest : str
+        清单文件, 格式见readManifest
+    weighted : bool, optional
+        是否按cfg边的rncost属性计算加权距离
+    native : bool, optional
+        是否用扩展模块_rndist计算cfg中的距离
+    """
+    loadArtifacts(path, dotPath, weighted, native)
+
+    jobs = readManifest(manifest, path)
+    for i, (tSrcsFile, outPath) in enumerate(jobs):
+        print("[%d/%d] %s -> %s" % (i + 1, len(jobs), tSrcsFile, outPath))
+        os.makedirs(outPath, exist_ok=True)
+        computeDistances(dotPath, tSrcsFile, outPath)
+
 
 # TODO: 不记录 cgDist > 64的各块信息
 # 可以把最大限度的cgDist作为一个命令行参数
@@ -601,10 +990,17 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser()
     parser.add_argument("-p", "--path", help="存储json, txt等文件的目录", required=True)
     parser.add_argument("-d", "--dot", help="存储dot文件的目录", required=True)
-    parser.add_argument("-t", "--taint", help="存储污点源信息的txt文件", required=True)
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument("-t", "--taint", help="存储污点源信息的txt文件")
+    group.add_argument("-m", "--manifest", help="批量计算: 每行为 \"污点源文件 [输出目录]\" 的清单")
+    parser.add_argument("-w", "--weighted", help="按cfg边的rncost属性(RnDuPass的-rndu-weighted)计算加权距离", action="store_true")
+    parser.add_argument("-n", "--native", help="用扩展模块_rndist(build/rndist)计算cfg中的距离, 结果不变", action="store_true")
     args = parser.parse_args()
 
     start = time.time()
-    distanceCalculation(args.path, args.dot, args.taint)
+    if args.manifest:
+        batchCalculation(args.path, args.dot, args.manifest, args.weighted, args.native)
+    else:
+        distanceCalculation(args.path, args.dot, args.taint, args.weighted, args.native)
     end = time.time()
     print("Calculation is finished, consumed %f seconds." % (end - start))
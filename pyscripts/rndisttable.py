@@ -0,0 +1,168 @@
+'''
+Author: Radon
+Date: 2026-10-19 14:02:37
+LastEditors: Radon
+LastEditTime: 2026-10-19 14:02:37
+Description: 距离表mydist.cfg.phf的生成与读取, 格式与查找方法见include/RnDistTable.h
+'''
+import mmap
+import struct
+
+TABLE_MAGIC = b"RNDIST01"
+HEADER_SIZE = 24
+DIRECT = 0x80000000
+BUCKET_SIZE = 2  # 平均每个桶的键数, 只有一个键的桶直接记录槽位, 桶越小其余的桶越容易找到位移
+
+
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+
+def rnDistHash(key: bytes) -> int:
+    """64位的FNV-1a, 与RnDistTable.h中的rn_dist_hash一致
+
+    Parameters
+    ----------
+    key : bytes
+        utf-8编码的基本块名字
+
+    Returns
+    -------
+    int
+        64位哈希值
+    """
+    h = 0xCBF29CE484222325
+    for b in key:
+        h = ((h ^ b) * 0x100000001B3) & MASK64
+    return h
+
+
+def rnDistMix(h: int, seed: int) -> int:
+    """把种子混入哈希值后做fmix64, 与RnDistTable.h中的rn_dist_mix一致
+
+    Parameters
+    ----------
+    h : int
+        rnDistHash的结果
+    seed : int
+        种子, 桶使用0, 槽位使用桶的位移
+
+    Returns
+    -------
+    int
+        32位的结果
+    """
+    h ^= (seed * 0x9E3779B97F4A7C15) & MASK64
+    h ^= h >> 33
+    h = (h * 0xFF51AFD7ED558CCD) & MASK64
+    h ^= h >> 33
+    h = (h * 0xC4CEB9FE1A85EC53) & MASK64
+    h ^= h >> 33
+    return h & 0xFFFFFFFF
+
+
+def writeDistTable(path: str, dists: dict):
+    """把<基本块名字, 距离>写为最小完美哈希表
+
+    按桶从大到小依次寻找让桶中所有键都落在空槽位的位移; 只有一个键的桶最后处理, 直接记录一个空槽位.
+    每个键只计算一次字符串哈希, 尝试位移时只需混入种子
+
+    Parameters
+    ----------
+    path : str
+        输出文件
+    dists : dict
+        <基本块名字, 距离>, 距离为非负整数
+    """
+    keys = [k.encode() for k in dists.keys()]
+    values = [int(v) for v in dists.values()]
+    n = len(keys)
+    nb = max(1, (n + BUCKET_SIZE - 1) // BUCKET_SIZE)
+
+    hashes = [rnDistHash(key) for key in keys]
+    if len(set(hashes)) != n:
+        raise ValueError("64-bit hash collision between block names")
+
+    buckets = [[] for _ in range(nb)]
+    for i, h in enumerate(hashes):
+        buckets[rnDistMix(h, 0) % nb].append(i)
+
+    disp = [0] * nb
+    slots = [-1] * n  # <槽位, 键的下标>
+    order = sorted(range(nb), key=lambda b: len(buckets[b]), reverse=True)
+    singles = []
+    for b in order:
+        items = buckets[b]
+        if len(items) <= 1:
+            if items:
+                singles.append(b)
+            continue
+
+        d = 1
+        while True:
+            pos = [rnDistMix(hashes[i], d) % n for i in items]
+            if len(set(pos)) == len(pos) and all(slots[p] < 0 for p in pos):
+                break
+            d += 1
+        disp[b] = d
+        for i, p in zip(items, pos):
+            slots[p] = i
+
+    freeSlots = (p for p in range(n) if slots[p] < 0)
+    for b in singles:
+        p = next(freeSlots)
+        disp[b] = DIRECT | p
+        slots[p] = buckets[b][0]
+
+    # 字符串池与槽位
+    pool = bytearray()
+    offsets = [0] * n
+    for i, key in enumerate(keys):
+        offsets[i] = len(pool)
+        pool += key + b"\0"
+
+    with open(path, "wb") as f:
+        f.write(TABLE_MAGIC + struct.pack("<IIII", n, nb, len(pool), 0))
+        f.write(struct.pack("<%dI" % nb, *disp))
+        f.write(struct.pack("<%dI" % (2 * n), *[x for i in slots for x in (offsets[i], values[i])]))
+        f.write(pool)
+
+
+class RnDistTable:
+    """mmap读取距离表, 查找时不解析整个文件"""
+
+    def __init__(self, path: str):
+        with open(path, "rb") as f:
+            self.buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        if self.buf[:8] != TABLE_MAGIC:
+            raise ValueError("Not a distance table: " + path)
+        self.n, self.nb, self.poolSize, _ = struct.unpack_from("<IIII", self.buf, 8)
+        self.slotOffset = HEADER_SIZE + 4 * self.nb
+        self.poolOffset = self.slotOffset + 8 * self.n
+
+    def __len__(self):
+        return self.n
+
+    def get(self, bbname: str):
+        """查找基本块的距离
+
+        Parameters
+        ----------
+        bbname : str
+            基本块名字, 形如filename:line
+
+        Returns
+        -------
+        int or None
+            距离, 不在表中时为None
+        """
+        if not self.n:
+            return None
+        key = bbname.encode()
+        h = rnDistHash(key)
+        d, = struct.unpack_from("<I", self.buf, HEADER_SIZE + 4 * (rnDistMix(h, 0) % self.nb))
+        slot = d & ~DIRECT if d & DIRECT else rnDistMix(h, d) % self.n
+        off, dist = struct.unpack_from("<II", self.buf, self.slotOffset + 8 * slot)
+        start = self.poolOffset + off
+        if self.buf[start:start + len(key) + 1] != key + b"\0":
+            return None
+        return dist
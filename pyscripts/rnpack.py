@@ -0,0 +1,90 @@
+'''
+Author: Radon
+Date: 2026-10-19 10:12:03
+LastEditors: Radon
+LastEditTime: 2026-10-19 10:12:03
+Description: 读取RnPass/RnDuPass打包输出的.rnpack文件
+'''
+import glob
+import gzip
+import os
+import struct
+
+PACK_MAGIC = b"RNPACK01"
+FOOTER_SIZE = 24
+
+
+class RnPack:
+    """单个.rnpack文件, 只读取索引, 图的内容按需随机读取
+
+    文件格式: [图1][图2]...[索引][尾部]
+    索引每行为 "类型\\t文件名\\t函数名\\t偏移\\t长度\\t编码", 编码为raw或gz
+    尾部为 "RNPACK01" + 索引偏移(uint64, 小端) + 索引长度(uint64, 小端)
+    """
+
+    def __init__(self, path: str):
+        self.path = path
+        self.index = dict()  # <(类型, 文件名, 函数名), (偏移, 长度, 编码)>
+
+        with open(path, "rb") as f:
+            f.seek(-FOOTER_SIZE, os.SEEK_END)
+            footer = f.read(FOOTER_SIZE)
+            if footer[:8] != PACK_MAGIC:
+                raise ValueError("Not a rnpack file: " + path)
+            indexOffset, indexSize = struct.unpack("<QQ", footer[8:])
+
+            f.seek(indexOffset)
+            for line in f.read(indexSize).decode().splitlines():
+                kind, filename, func, offset, size, enc = line.split("\t")
+                self.index[(kind, filename, func)] = (int(offset), int(size), enc)
+
+    def read(self, kind: str, filename: str, func: str) -> str:
+        """读取一个函数的图
+
+        Parameters
+        ----------
+        kind : str
+            cfg, dfg 或 dfg-origin
+        filename : str
+            函数所在的文件名
+        func : str
+            函数名
+
+        Returns
+        -------
+        str
+            dot格式的图
+        """
+        offset, size, enc = self.index[(kind, filename, func)]
+        with open(self.path, "rb") as f:
+            f.seek(offset)
+            data = f.read(size)
+        if enc == "gz":
+            data = gzip.decompress(data)
+        return data.decode()
+
+
+class RnPackDir:
+    """目录下的所有.rnpack文件, 合并它们的索引"""
+
+    def __init__(self, path: str):
+        self.packs = dict()  # <(类型, 文件名, 函数名), RnPack>
+        self.funcs = dict()  # <(类型, 函数名), (文件名, RnPack)>, 用于只知道函数名时的查找
+
+        for packPath in sorted(glob.glob(os.path.join(path, "*.rnpack"))):
+            pack = RnPack(packPath)
+            for kind, filename, func in pack.index.keys():
+                self.packs[(kind, filename, func)] = pack
+                self.funcs.setdefault((kind, func), (filename, pack))
+
+    def __bool__(self):
+        return len(self.packs) > 0
+
+    def read(self, kind: str, filename: str, func: str) -> str:
+        """按(文件名, 函数名)读取图, 找不到时退化为只按函数名查找"""
+        key = (kind, filename, func)
+        if key in self.packs:
+            return self.packs[key].read(kind, filename, func)
+
+        filename, pack = self.funcs[(kind, func)]
+        return pack.read(kind, filename, func)
@@ -14,6 +14,8 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/EquivalenceClasses.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/CFGPrinter.h"
 #include "llvm/IR/DebugInfo.h"
@@ -28,8 +30,43 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Use.h"
 #include "llvm/IR/Value.h"
+
+#include "RnBudget.h"
+#include "RnOutput.h"
+#include "RnTarget.h"
+#include "RnWriter.h"
+
 using namespace llvm;
 
+#define DEBUG_TYPE "rnpass"
+
+STATISTIC(NumDegradedFuncs, "Number of functions over the analysis budget that got a summary DFG");
+STATISTIC(NumStmtMergedInsts, "Number of instructions merged into statement-level DFG nodes");
+STATISTIC(NumSliceNodes, "Number of DFG nodes kept by -rn-slice");
+
+
+/* 命令行参数 */
+static cl::opt<bool> RnCompress("rn-compress", cl::desc("Compress all output files with zlib (written as *.gz)"), cl::init(false));
+static cl::opt<bool> RnPack("rn-pack", cl::desc("Write all DFGs of a module into one indexed ./dfg-files/dfg<N>.rnpack"), cl::init(false));
+static cl::opt<bool> RnLTO("rn-lto", cl::desc("Run once over the merged module at full LTO link time instead of once per TU"), cl::init(false));
+static cl::opt<std::string> RnTaintFile("rn-taint", cl::desc("Only emit graphs of functions near the taint sources in this file (requires -rn-lto)"), cl::value_desc("filename"), cl::init(""));
+static cl::opt<unsigned> RnMaxInsts("rn-max-insts", cl::desc("Summarize functions with more instructions than this (0: unlimited)"), cl::init(0));
+static cl::opt<unsigned> RnMaxEdges("rn-max-edges", cl::desc("Summarize functions with more DFG edges than this (0: unlimited)"), cl::init(0));
+static cl::opt<unsigned> RnMaxMillis("rn-max-ms", cl::desc("Summarize functions whose analysis takes longer than this many ms (0: unlimited)"), cl::init(0));
+static cl::opt<int> RnTaintDist("rn-taint-dist", cl::desc("Max call distance from a taint function for -rn-taint (-1: unlimited)"), cl::init(-1));
+static cl::opt<bool> RnICall("rn-icall", cl::desc("Resolve indirect calls to address-taken functions of the same type"), cl::init(false));
+static cl::opt<unsigned> RnICallMaxFanout("rn-icall-max-fanout", cl::desc("Drop indirect call sites with more candidate callees than this (0: unlimited)"), cl::init(16));
+static cl::opt<bool> RnStmtDFG("rn-stmt-dfg", cl::desc("Collapse instructions of one source line and single-use values into statement-level DFG nodes"), cl::init(false));
+enum RnSliceDir { RnSliceBoth, RnSliceForward, RnSliceBackward };
+static cl::list<std::string> RnSlice("rn-slice", cl::desc("Only emit the data-flow slice of these source lines"), cl::value_desc("file:line"), cl::CommaSeparated);
+static cl::opt<RnSliceDir> RnSliceDirection("rn-slice-dir", cl::desc("Direction of -rn-slice"),
+                                            cl::values(clEnumValN(RnSliceBoth, "both", "Forward and backward slice"),
+                                                       clEnumValN(RnSliceForward, "forward", "Values affected by the lines"),
+                                                       clEnumValN(RnSliceBackward, "backward", "Values the lines depend on")),
+                                            cl::init(RnSliceBoth));
+static cl::opt<bool> RnPGO("rn-pgo", cl::desc("Write summary DFGs for functions that are cold in the module's profile"), cl::init(false));
+static cl::opt<unsigned> RnWriteQueue("rn-write-queue", cl::desc("Max outputs queued for the background writer thread (0: write on the compile thread)"), cl::init(64));
+
 
 namespace {
   class RnPass : public ModulePass {
@@ -44,6 +81,13 @@ namespace {
     NodeList Nodes;     //存储每一条指令
     int Num;            //计数
 
+    /* 切片时暂存的一个函数的图 */
+    struct FuncDFG {
+      Function *F;
+      NodeList Nodes;
+      EdgeList Edges, InstEdges;
+    };
+
     std::unordered_map<Value *, std::string> DbgLocMap; //记录指令及其对应的源文件位置
 
     static char ID;
@@ -53,8 +97,12 @@ namespace {
     }
 
     StringRef getValueName(Value *V);
-    void writeDFG_origin(raw_fd_ostream &File, Function &F);
-    void writeDFG(raw_fd_ostream &File, Function &F);
+    void writeDFG_origin(raw_ostream &File, Function &F);
+    void writeDFG(raw_ostream &File, Function &F);
+    void writeSummaryDFG(raw_ostream &File, Function &F);
+    void writeStmtDFG(raw_ostream &File, Function &F);
+    void sliceDFGs(std::vector<FuncDFG> &DFGs, const RnSigIndex *ICalls);
+    void getAnalysisUsage(AnalysisUsage &AU) const override;
     bool runOnModule(Module &M) override;
   };
 } // namespace
@@ -130,6 +178,27 @@ static bool isBlacklisted(const Function *F) {
 }
 
 
+/**
+ * @brief 获取指令所在位置"文件名:行号"(文件名不含路径), 获取不到或属于external libs时返回空
+ *
+ * @param I
+ * @return std::string
+ */
+static std::string getLocName(const Instruction &I) {
+  std::string filename;
+  unsigned line = 0;
+  getDebugLoc(&I, filename, line);
+  static const std::string Xlibs("/usr/");
+  if (!filename.compare(0, Xlibs.size(), Xlibs) || filename.empty() || !line)
+    return "";
+
+  std::size_t found = filename.find_last_of("/\\");
+  if (found != std::string::npos)
+    filename = filename.substr(found + 1);
+  return filename + ":" + std::to_string(line);
+}
+
+
 /**
  * @brief 如果是变量则获得变量的名字,是指令则获得指令的内容
  *
@@ -160,7 +229,7 @@ StringRef RnPass::getValueName(Value *V) {
  * @param File
  * @param F
  */
-void RnPass::writeDFG_origin(raw_fd_ostream &File, Function &F) {
+void RnPass::writeDFG_origin(raw_ostream &File, Function &F) {
   /* 根据边的统计情况画图 */
   File << "digraph \"DFG for \'" + F.getName() + "\' function\" {\n";
   /* Dump Node */
@@ -191,7 +260,7 @@ void RnPass::writeDFG_origin(raw_fd_ostream &File, Function &F) {
  * @param File
  * @param F
  */
-void RnPass::writeDFG(raw_fd_ostream &File, Function &F) {
+void RnPass::writeDFG(raw_ostream &File, Function &F) {
   /* 根据边的统计情况画图 */
   File << "digraph \"DFG for \'" + F.getName() + "\' function\" {\n";
   /* Dump Node */
@@ -210,6 +279,229 @@ void RnPass::writeDFG(raw_fd_ostream &File, Function &F) {
 }
 
 
+/**
+ * @brief 画数据流图-概要, 用于超出分析预算的函数: 每个基本块一个节点, 标签中是块内读写的变量, 边为块之间的控制流
+ *
+ * @param File
+ * @param F
+ */
+void RnPass::writeSummaryDFG(raw_ostream &File, Function &F) {
+  File << "digraph \"Summary DFG for \'" + F.getName() + "\' function\" {\n";
+  /* Dump Node */
+  for (auto &BB : F) {
+    std::string label;
+    std::set<std::string> vars;
+    for (auto &I : BB) {
+      if (label.empty())
+        label = getLocName(I);
+
+      Value *Ptr = nullptr;
+      if (auto *LInst = dyn_cast<LoadInst>(&I))
+        Ptr = LInst->getPointerOperand();
+      else if (auto *SInst = dyn_cast<StoreInst>(&I))
+        Ptr = SInst->getPointerOperand();
+      if (Ptr && Ptr->stripPointerCasts()->hasName())
+        vars.insert(Ptr->stripPointerCasts()->getName().str());
+    }
+
+    if (label.empty())
+      label = "undefined:0";
+    label += ":";
+    for (auto &var : vars)
+      label += var + ",";
+    if (!vars.empty())
+      label.pop_back();
+
+    File << "\tNode" << &BB << "[shape=record, label=\"" << label << "\"];\n";
+  }
+  /* Dump block-level flow */
+  for (auto &BB : F) {
+    for (BasicBlock *SucBB : successors(&BB))
+      File << "\tNode" << &BB << " -> Node" << SucBB << " [color=red]\n";
+  }
+  File << "}\n";
+}
+
+
+/**
+ * @brief 画数据流图-语句级: 同一行的指令, 以及只有一个使用者的中间值与其使用者合并为一个节点, 边去重且不含自环.
+ * 节点的标签为"文件名:行号:变量", 变量是合并的各指令中变量的并集
+ *
+ * @param File
+ * @param F
+ */
+void RnPass::writeStmtDFG(raw_ostream &File, Function &F) {
+  /* 合并指令. alloca代表变量本身, 不并入使用它的语句 */
+  EquivalenceClasses<Value *> stmts;
+  std::unordered_set<Value *> funcInsts;
+  std::map<std::string, Value *> lineInsts;
+  for (auto &N : Nodes)
+    funcInsts.insert(N.first);
+  for (auto &N : Nodes) {
+    Instruction *I = cast<Instruction>(N.first);
+    stmts.insert(I);
+    std::string loc = getLocName(*I);
+    if (!loc.empty()) {
+      auto res = lineInsts.emplace(loc, I);
+      if (!res.second)
+        stmts.unionSets(res.first->second, I);
+    }
+    if (!isa<AllocaInst>(I) && I->hasOneUse()) {
+      Value *User = I->user_back();
+      if (funcInsts.count(User))
+        stmts.unionSets(I, User);
+    }
+  }
+
+  /* 每个语句以其中第一条指令为代表, 合并各指令的位置与变量 */
+  std::unordered_map<Value *, Value *> reps; // <等价类的leader, 代表>
+  std::vector<Value *> order;
+  std::unordered_map<Value *, std::string> locs, labels;
+  std::unordered_map<Value *, std::set<std::string>> seenVars;
+  for (auto &N : Nodes) {
+    auto res = reps.emplace(stmts.getLeaderValue(N.first), N.first);
+    Value *rep = res.first->second;
+    if (res.second)
+      order.push_back(rep);
+    else
+      NumStmtMergedInsts++;
+
+    const std::string &label = DbgLocMap[N.first];
+    std::size_t sep = label.rfind(':');
+    std::string loc = label.substr(0, sep);
+    if (locs[rep].empty() || (locs[rep] == "undefined:0" && loc != "undefined:0"))
+      locs[rep] = loc;
+    StringRef vars = StringRef(label).substr(sep + 1);
+    while (!vars.empty()) {
+      std::pair<StringRef, StringRef> var = vars.split(',');
+      if (!var.first.empty() && seenVars[rep].insert(var.first.str()).second)
+        labels[rep] += (labels[rep].empty() ? "" : ",") + var.first.str();
+      vars = var.second;
+    }
+  }
+  auto getStmt = [&](Value *V) {
+    return funcInsts.count(V) ? reps[stmts.getLeaderValue(V)] : V;
+  };
+
+  File << "digraph \"DFG for \'" + F.getName() + "\' function\" {\n";
+  /* Dump Node */
+  for (Value *rep : order)
+    File << "\tNode" << rep << "[shape=record, label=\"" << locs[rep] << ":" << labels[rep] << "\"];\n";
+  /*Dump data flow*/
+  std::set<std::pair<Value *, Value *>> written;
+  for (EdgeList::iterator it = Edges.begin(); it != Edges.end(); it++) {
+    Value *From = getStmt(it->first.first), *To = getStmt(it->second.first);
+    if (From != To && written.insert(std::make_pair(From, To)).second)
+      File << "\tNode" << From << " -> Node" << To << " [color=red]\n";
+  }
+  File << "}\n";
+  errs() << "Write Done\n";
+}
+
+
+/**
+ * @brief 从-rn-slice指定的行出发做前向与后向切片, 各函数的图只保留切片中的节点以及两端都在切片中的边.
+ * 切片沿数据流边(经由alloca与全局变量等指针节点的边即为内存边)进行, 跨函数时沿实参到形参, 返回值到调用点的边
+ *
+ * @param DFGs 所有函数的图
+ * @param ICalls 间接调用的签名索引, 为空时只跟随直接调用
+ */
+void RnPass::sliceDFGs(std::vector<FuncDFG> &DFGs, const RnSigIndex *ICalls) {
+  /* 行的格式与标签中的相同: 文件名不含路径 */
+  std::set<std::string> lines;
+  for (auto &L : RnSlice) {
+    std::size_t found = L.find_last_of("/\\");
+    lines.insert(found == std::string::npos ? L : L.substr(found + 1));
+  }
+
+  DenseMap<const Function *, FuncDFG *> funcDFGs;
+  for (auto &D : DFGs)
+    funcDFGs[D.F] = &D;
+
+  /* 整个模块的数据流边 */
+  DenseMap<Value *, SmallVector<Value *, 4>> succs, preds;
+  auto addEdge = [&](Value *From, Value *To) {
+    succs[From].push_back(To);
+    preds[To].push_back(From);
+  };
+  std::vector<Value *> seeds;
+  for (auto &D : DFGs) {
+    for (auto &E : D.Edges)
+      addEdge(E.first.first, E.second.first);
+
+    for (auto &N : D.Nodes) {
+      Instruction *I = cast<Instruction>(N.first);
+      if (lines.count(getLocName(*I)))
+        seeds.push_back(I);
+
+      auto *CB = dyn_cast<CallBase>(I);
+      if (!CB)
+        continue;
+      SmallVector<const Function *, 8> callees;
+      getRnCallees(*CB, ICalls, RnICallMaxFanout, callees);
+      for (const Function *Callee : callees) {
+        auto it = funcDFGs.find(Callee);
+        if (it == funcDFGs.end())
+          continue;
+        Function *CalleeF = it->second->F;
+        for (unsigned i = 0; i < CB->arg_size() && i < CalleeF->arg_size(); i++)
+          addEdge(CB->getArgOperand(i), CalleeF->getArg(i));
+        for (auto &RN : it->second->Nodes) {
+          if (isa<ReturnInst>(RN.first))
+            addEdge(RN.first, CB);
+        }
+      }
+    }
+  }
+  if (seeds.empty())
+    errs() << "No instruction found on the -rn-slice lines\n";
+
+  /* 前向与后向分别遍历, 切片为两者的并集 */
+  auto walk = [&seeds](DenseMap<Value *, SmallVector<Value *, 4>> &Adj, DenseSet<Value *> &Slice) {
+    std::vector<Value *> work(seeds);
+    Slice.insert(seeds.begin(), seeds.end());
+    while (!work.empty()) {
+      Value *V = work.back();
+      work.pop_back();
+      auto it = Adj.find(V);
+      if (it == Adj.end())
+        continue;
+      for (Value *W : it->second) {
+        if (Slice.insert(W).second)
+          work.push_back(W);
+      }
+    }
+  };
+  DenseSet<Value *> slice;
+  if (RnSliceDirection != RnSliceBackward)
+    walk(succs, slice);
+  if (RnSliceDirection != RnSliceForward) {
+    DenseSet<Value *> backSlice;
+    walk(preds, backSlice);
+    slice.insert(backSlice.begin(), backSlice.end());
+  }
+
+  auto inSlice = [&slice](const Edge &E) { return slice.count(E.first.first) && slice.count(E.second.first); };
+  for (auto &D : DFGs) {
+    D.Nodes.remove_if([&slice](const Node &N) { return !slice.count(N.first); });
+    D.Edges.remove_if([&inSlice](const Edge &E) { return !inSlice(E); });
+    D.InstEdges.remove_if([&inSlice](const Edge &E) { return !inSlice(E); });
+    NumSliceNodes += D.Nodes.size();
+  }
+}
+
+
+/**
+ * @brief 开启-rn-pgo时需要模块的profile summary
+ *
+ * @param AU
+ */
+void RnPass::getAnalysisUsage(AnalysisUsage &AU) const {
+  if (RnPGO)
+    AU.addRequired<ProfileSummaryInfoWrapperPass>();
+}
+
+
 /**
  * @brief 重写runOnModule,在编译被测对象的过程中获取数据流图
  *
@@ -229,7 +521,83 @@ bool RnPass::runOnModule(Module &M) {
   }
 
   /* 获得源码中的函数调用信息, 表现形式为: 文件名:行号, 调用的函数 */
-  std::ofstream linecalls("./dfg-files/linecalls.txt", std::ofstream::out | std::ofstream::app);
+  std::string linecallsData;
+  raw_string_ostream linecalls(linecallsData);
+
+  /* 打包输出时, 一个模块的所有dfg写入同一个文件 */
+  std::unique_ptr<RnPackWriter> pack;
+  if (RnPack) {
+    int packIdx = 0;
+    while (sys::fs::exists("./dfg-files/dfg" + std::to_string(packIdx) + ".rnpack"))
+      packIdx++;
+    pack.reset(new RnPackWriter("./dfg-files/dfg" + std::to_string(packIdx) + ".rnpack", RnCompress));
+  }
+
+  /* 序列化好的图交给后台线程写入, 打包文件也只在后台线程上访问 */
+  RnAsyncWriter writer(RnWriteQueue);
+
+  /* 间接调用按函数类型查找候选的被调用函数 */
+  RnSigIndex sigIndex;
+  if (RnICall)
+    buildRnSigIndex(M, sigIndex);
+  const RnSigIndex *icalls = RnICall ? &sigIndex : nullptr;
+
+  /* 指定污点源时, 只输出与污点源调用距离足够近的函数的图 */
+  std::set<const Function *> targetFuncs;
+  bool targeted = false;
+  if (!RnTaintFile.empty() && !RnLTO) { // 逐个编译单元分析时调用图不完整, 没有污点源的编译单元会不输出任何图
+    errs() << "-rn-taint needs the whole program's call graph, ignored without -rn-lto\n";
+  } else if (!RnTaintFile.empty()) {
+    std::set<std::string> taints;
+    if (readRnTaints(RnTaintFile, taints)) {
+      getRnTargetFuncs(M, taints, RnTaintDist, getLocName, targetFuncs, icalls, RnICallMaxFanout);
+      targeted = true;
+    } else
+      errs() << "Could not read taint file: " << RnTaintFile << "\n";
+  }
+
+  /* 单个函数的分析预算, 超出时输出概要; 开启-rn-pgo时profile中冷的函数也输出概要 */
+  RnBudget budget(RnMaxInsts, RnMaxEdges, RnMaxMillis);
+  ProfileSummaryInfo *PSI = RnPGO ? &getAnalysis<ProfileSummaryInfoWrapperPass>().getPSI() : nullptr;
+  std::string degradedData;
+  raw_string_ostream degradedOS(degradedData);
+
+  /* 输出一个函数的图, 超出预算的函数输出概要 */
+  auto emitDFG = [&](Function &F, bool degraded) {
+    if (!Nodes.empty() || degraded) {
+      std::string DFGOrigin, DFGRn;
+      raw_string_ostream FileOS(DFGOrigin), FileRnOS(DFGRn);
+      if (degraded) {
+        writeSummaryDFG(FileOS, F);
+        writeSummaryDFG(FileRnOS, F);
+      } else {
+        writeDFG_origin(FileOS, F);
+        if (RnStmtDFG)
+          writeStmtDFG(FileRnOS, F);
+        else
+          writeDFG(FileRnOS, F);
+      }
+      FileOS.flush();
+      FileRnOS.flush();
+
+      if (pack) {
+        RnPackWriter *P = pack.get();
+        std::string FuncFile = getRnFuncFile(F), FuncName = F.getName().str();
+        writer.post([P, FuncFile, FuncName, DFGOrigin = std::move(DFGOrigin), DFGRn = std::move(DFGRn)]() {
+          P->add("dfg-origin", FuncFile, FuncName, DFGOrigin);
+          P->add("dfg", FuncFile, FuncName, DFGRn);
+        });
+      } else {
+        writer.write("./dfg-files-origin/dfg." + F.getName().str() + ".dot", std::move(DFGOrigin), RnCompress); //原本的文件输出
+        writer.write("./dfg-files/dfg." + F.getName().str() + ".dot", std::move(DFGRn), RnCompress);             //我的文件输出
+        errs() << "Write Done\n";
+      }
+    }
+  };
+
+  /* 指定-rn-slice时只输出切片, 超出预算的函数不参与切片 */
+  bool slicing = !RnSlice.empty();
+  std::vector<FuncDFG> sliced;
 
   /* 获取每个函数的dfg */
   for (auto &F : M) {
@@ -241,6 +609,7 @@ bool RnPass::runOnModule(Module &M) {
     Edges.clear();
     Nodes.clear();
     InstEdges.clear();
+    bool degraded = budget.start(F, PSI);
 
     errs() << "===============" << F.getName() << "===============\n";
     for (Function::iterator BB = F.begin(); BB != F.end(); BB++) { //使用迭代器遍历Function,如果用"auto& BB : F"的话后续的一些操作无法进行
@@ -256,28 +625,34 @@ bool RnPass::runOnModule(Module &M) {
         if (!filename.compare(0, Xlibs.size(), Xlibs))
           continue;
 
-        switch (CurI->getOpcode()) { //根据博客所述,在IR中只有load和store指令直接与内存接触,所以通过它们获取数据流的边
-          case Instruction::Load: {
-            LoadInst *LInst = dyn_cast<LoadInst>(CurI);     // dyn_cast用于检查操作数是否属于指定类型,在这里是检查CurI是否属于LoadInst型.如果是的话就返回指向它的指针,不是的话返回空指针
-            Value *LoadValPtr = LInst->getPointerOperand(); //获取指针操作数?获取指向的操作数?
-            Edges.push_back(Edge(Node(LoadValPtr, getValueName(LoadValPtr)), Node(CurI, getValueName(CurI))));
-            break;
-          }
-          case Instruction::Store: {
-            StoreInst *SInst = dyn_cast<StoreInst>(CurI);
-            Value *StoreValPtr = SInst->getPointerOperand();
-            Value *StoreVal = SInst->getValueOperand();
-            Edges.push_back(Edge(Node(StoreVal, getValueName(StoreVal)), Node(CurI, getValueName(CurI))));
-            Edges.push_back(Edge(Node(CurI, getValueName(CurI)), Node(StoreValPtr, getValueName(StoreValPtr))));
-            break;
-          }
-          default: { //对于其他指令,遍历每一个指令的操作数,判断其是不是一个指令,如果是一个指令的话就添加相应的边
-            for (Instruction::op_iterator op = CurI->op_begin(); op != CurI->op_end(); op++) {
-              if (dyn_cast<Instruction>(*op)) { //这里和数据流有关?
-                Edges.push_back(Edge(Node(op->get(), getValueName(op->get())), Node(CurI, getValueName(CurI))));
+        /* 超出预算后只记录函数调用信息 */
+        if (!degraded && budget.exceeded(Edges.size()))
+          degraded = true;
+
+        if (!degraded) {
+          switch (CurI->getOpcode()) { //根据博客所述,在IR中只有load和store指令直接与内存接触,所以通过它们获取数据流的边
+            case Instruction::Load: {
+              LoadInst *LInst = dyn_cast<LoadInst>(CurI);     // dyn_cast用于检查操作数是否属于指定类型,在这里是检查CurI是否属于LoadInst型.如果是的话就返回指向它的指针,不是的话返回空指针
+              Value *LoadValPtr = LInst->getPointerOperand(); //获取指针操作数?获取指向的操作数?
+              Edges.push_back(Edge(Node(LoadValPtr, getValueName(LoadValPtr)), Node(CurI, getValueName(CurI))));
+              break;
+            }
+            case Instruction::Store: {
+              StoreInst *SInst = dyn_cast<StoreInst>(CurI);
+              Value *StoreValPtr = SInst->getPointerOperand();
+              Value *StoreVal = SInst->getValueOperand();
+              Edges.push_back(Edge(Node(StoreVal, getValueName(StoreVal)), Node(CurI, getValueName(CurI))));
+              Edges.push_back(Edge(Node(CurI, getValueName(CurI)), Node(StoreValPtr, getValueName(StoreValPtr))));
+              break;
+            }
+            default: { //对于其他指令,遍历每一个指令的操作数,判断其是不是一个指令,如果是一个指令的话就添加相应的边
+              for (Instruction::op_iterator op = CurI->op_begin(); op != CurI->op_end(); op++) {
+                if (dyn_cast<Instruction>(*op)) { //这里和数据流有关?
+                  Edges.push_back(Edge(Node(op->get(), getValueName(op->get())), Node(CurI, getValueName(CurI))));
+                }
               }
+              break;
             }
-            break;
           }
         }
         // Alloca指令用于栈空间的分配 (来源: https://llvm.org/docs/LangRef.html)
@@ -310,9 +685,11 @@ bool RnPass::runOnModule(Module &M) {
         if (found != std::string::npos)
           filename = filename.substr(found + 1);
 
-        /* 获取函数调用信息 */
+        /* 获取函数调用信息, 开启-rn-icall时间接调用的每个候选各占一行 */
         if (auto *c = dyn_cast<CallInst>(CurI)) {
-          if (auto *CalledF = c->getCalledFunction()) {
+          SmallVector<const Function *, 8> calledFs;
+          getRnCallees(*c, icalls, RnICallMaxFanout, calledFs);
+          for (const Function *CalledF : calledFs) {
             if (!isBlacklisted(CalledF)) {
               /* TODO: 函数调用的表达形式 */
               linecalls << filename << ":" << line << "," << CalledF->getName().str() << ",";
@@ -324,6 +701,9 @@ bool RnPass::runOnModule(Module &M) {
           }
         }
 
+        if (degraded)
+          continue;
+
         /* 更新map,将指令和其所在位置对应起来 */
         if (filename.empty() || !line) //如果获取不到文件名或行号的话,label变为undefined
           DbgLocMap[CurI] = "undefined:0";
@@ -347,6 +727,8 @@ bool RnPass::runOnModule(Module &M) {
         if (Next != CurBB->end()) //这里是在统计控制流的边
           InstEdges.push_back(Edge(Node(CurI, getValueName(CurI)), Node(&*Next, getValueName(&*Next))));
       }
+      if (degraded)
+        continue;
       Instruction *Terminator = CurBB->getTerminator();
       for (BasicBlock *SucBB : successors(CurBB)) {
         Instruction *First = &*(SucBB->begin());
@@ -354,31 +736,66 @@ bool RnPass::runOnModule(Module &M) {
       }
     }
 
-    /* 画数据流图 */
-    if (!Nodes.empty()) {
-      std::error_code EC;
-      std::string FileName("./dfg-files-origin/dfg." + F.getName().str() + ".dot");
-      raw_fd_ostream File(FileName, EC, sys::fs::F_None); //原本的文件输出
+    /* 记录超出预算的函数 */
+    if (degraded) {
+      Edges.clear();
+      Nodes.clear();
+      InstEdges.clear();
+      NumDegradedFuncs++;
 
-      std::string FileNameRn = "./dfg-files/dfg." + F.getName().str() + ".dot";
-      raw_fd_ostream FileRn(FileNameRn, EC, sys::fs::F_None); //我的文件输出
+      errs() << "Over budget, writing summary DFG for " << F.getName() << ": " << budget.reason() << "\n";
+      degradedOS << F.getName() << "," << budget.reason() << "\n";
+    }
 
-      if (!EC) {
-        writeDFG_origin(File, F);
-        writeDFG(FileRn, F);
+    /* 与污点源无关的函数不输出 */
+    if (targeted && !targetFuncs.count(&F) && !slicing)
+      continue;
+
+    /* 切片时先暂存各函数的图, 所有函数分析完后再输出切片 */
+    if (slicing) {
+      if (!Nodes.empty()) {
+        sliced.push_back(FuncDFG{&F, {}, {}, {}});
+        sliced.back().Nodes.swap(Nodes);
+        sliced.back().Edges.swap(Edges);
+        sliced.back().InstEdges.swap(InstEdges);
       }
-      File.close();
-      FileRn.close();
-      errs() << "Write Done\n";
+      continue;
+    }
+
+    /* 画数据流图 */
+    emitDFG(F, degraded);
+  }
+
+  if (slicing) {
+    sliceDFGs(sliced, icalls);
+    for (auto &D : sliced) {
+      if (targeted && !targetFuncs.count(D.F))
+        continue;
+      Nodes.swap(D.Nodes);
+      Edges.swap(D.Edges);
+      InstEdges.swap(D.InstEdges);
+      emitDFG(*D.F, false);
     }
   }
+
+  linecalls.flush();
+  writer.write("./dfg-files/linecalls.txt", std::move(linecallsData), RnCompress, sys::fs::F_Append);
+  if (!degradedOS.str().empty())
+    writer.write("./dfg-files/degraded.txt", std::move(degradedData), RnCompress, sys::fs::F_Append);
+  writer.finish();
   return false;
 }
 
 
-/* 注册Pass */
+/* 注册Pass, 开启-rn-lto时只在链接时对合并后的模块运行一次 */
 static void registerRnPass(const PassManagerBuilder &, legacy::PassManagerBase &PM) {
-  PM.add(new RnPass());
+  if (!RnLTO)
+    PM.add(new RnPass());
+}
+static void registerRnPassLTO(const PassManagerBuilder &, legacy::PassManagerBase &PM) {
+  if (RnLTO)
+    PM.add(new RnPass());
 }
 static RegisterStandardPasses RegisterRnPass(PassManagerBuilder::EP_OptimizerLast, registerRnPass);
-static RegisterStandardPasses RegisterRnPass0(PassManagerBuilder::EP_EnabledOnOptLevel0, registerRnPass);
\ No newline at end of file
+static RegisterStandardPasses RegisterRnPass0(PassManagerBuilder::EP_EnabledOnOptLevel0, registerRnPass);
+static RegisterStandardPasses RegisterRnPassLTO(PassManagerBuilder::EP_FullLinkTimeOptimizationLast, registerRnPassLTO);
\ No newline at end of file
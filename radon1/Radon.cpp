@@ -1,7 +1,9 @@
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <list>
 #include <map>
+#include <queue>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -14,6 +16,8 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/CFGPrinter.h"
 #include "llvm/IR/DebugInfo.h"
@@ -24,18 +28,51 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/JSON.h"
 
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
 #include "llvm/Analysis/CFG.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Use.h"
 #include "llvm/IR/Value.h"
 
+#include "RnAccessPath.h"
+#include "RnBudget.h"
+#include "RnOutput.h"
+#include "RnTarget.h"
+#include "RnWriter.h"
+
 using namespace llvm;
 
+#define DEBUG_TYPE "rndupass"
+
+STATISTIC(NumDegradedFuncs, "Number of functions over the analysis budget that got coarse def-use");
+
+
+/* 命令行参数 */
+static cl::opt<bool> DuCompress("rndu-compress", cl::desc("Compress all output files with zlib (written as *.gz)"), cl::init(false));
+static cl::opt<bool> DuPack("rndu-pack", cl::desc("Write all CFGs of a module into one indexed cfg<N>.rnpack"), cl::init(false));
+static cl::opt<std::string> DuTaintFile("rndu-taint", cl::desc("Only emit graphs of functions near the taint sources in this file (requires -rndu-lto)"), cl::value_desc("filename"), cl::init(""));
+static cl::opt<unsigned> DuMaxInsts("rndu-max-insts", cl::desc("Use coarse def-use for functions with more instructions than this (0: unlimited)"), cl::init(0));
+static cl::opt<unsigned> DuMaxEdges("rndu-max-edges", cl::desc("Use coarse def-use for functions with more CFG edges than this (0: unlimited)"), cl::init(0));
+static cl::opt<unsigned> DuMaxMillis("rndu-max-ms", cl::desc("Use coarse def-use once a function's analysis takes longer than this many ms (0: unlimited)"), cl::init(0));
+static cl::opt<int> DuTaintDist("rndu-taint-dist", cl::desc("Max call distance from a taint function for -rndu-taint (-1: unlimited)"), cl::init(-1));
+static cl::opt<bool> DuLTO("rndu-lto", cl::desc("Run once over the merged module at full LTO link time instead of once per TU"), cl::init(false));
+static cl::opt<bool> DuWeighted("rndu-weighted", cl::desc("Weight CFG edges by BlockFrequencyInfo/BranchProbabilityInfo (rncost edge attribute in the cfg dots)"), cl::init(false));
+static cl::opt<std::string> DuDistTargets("rndu-dist-targets", cl::desc("With -rndu-weighted, write weighted distances to the blocks of these \"file:line\" targets to wdist<N>.cfg.txt"), cl::value_desc("filename"), cl::init(""));
+static cl::opt<unsigned> DuWeightedMaxCost("rndu-weighted-max-cost", cl::desc("Max cost of a single CFG edge for -rndu-weighted"), cl::init(32));
+static cl::opt<bool> DuRD("rndu-rd", cl::desc("Solve intra-procedural reaching definitions and write def line -> use line edges to duEdge<N>.json"), cl::init(false));
+static cl::opt<bool> DuICall("rndu-icall", cl::desc("Resolve indirect calls to address-taken functions of the same type"), cl::init(false));
+static cl::opt<unsigned> DuICallMaxFanout("rndu-icall-max-fanout", cl::desc("Drop indirect call sites with more candidate callees than this (0: unlimited)"), cl::init(16));
+static cl::opt<bool> DuPGO("rndu-pgo", cl::desc("Use coarse def-use for functions that are cold in the module's profile, and give their CFG edges the max cost with -rndu-weighted"), cl::init(false));
+static cl::opt<bool> DuFieldPaths("rndu-field-paths", cl::desc("Name def-use of struct fields and constant array elements by access path (s.1[2]) and write the paths to accessPath<N>.json"), cl::init(false));
+static cl::opt<unsigned> DuFieldDepth("rndu-field-depth", cl::desc("Max fields and indices kept in an access path for -rndu-field-paths"), cl::init(4));
+static cl::opt<unsigned> DuWriteQueue("rndu-write-queue", cl::desc("Max outputs queued for the background writer thread (0: write on the compile thread)"), cl::init(64));
+
 
 /* 全局变量 */
 std::map<std::string, std::map<std::string, std::set<std::string>>> duVarMap;                 // 存储变量的def-use信息的map: <文件名与行号, <def/use, 变量>>
-std::map<Value *, std::string> dbgLocMap;                                                     // 存储指令和其对应的在源文件中位置的map, <指令, 文件名与行号>
+std::map<const BasicBlock *, std::string> bbLabelMap;                                         // <基本块, 其在cfg中的标签>, 编译时丢弃了变量名时基本块无法setName, 标签从这里获取
 std::map<std::string, std::vector<std::string>> funcParamMap;                                 // 存储函数和其形参的map, 用这个map主要是为了防止出现跨文件调用函数时参数丢失的问题
 std::map<std::string, std::map<std::string, std::vector<std::set<std::string>>>> callArgsMap; // <行, <调用的函数, 实参>>
 std::map<std::string, std::set<std::string>> bbLineMap;                                       // 存储bb和其所包含所有行的map, <bb名字, 集合(包含的所有行)>
@@ -43,6 +80,20 @@ std::map<std::string, std::string> funcEntryMap;
 std::map<std::string, std::string> bbFuncMap;                                                 // <bb名, 其所在函数名>
 std::map<std::string, std::string> linebbMap;                                                 // <行, 其所在bb>
 std::map<std::string, int> maxLineMap;                                                        // <filename, 文件行数>
+std::map<std::pair<const BasicBlock *, const BasicBlock *>, unsigned> edgeCostMap;            // <cfg中的边, 按执行频率得到的代价>, 开启-rndu-weighted时才有
+std::map<std::string, std::map<std::string, std::set<std::string>>> duEdgeMap;                // <def所在的行, <use所在的行, 变量>>, 开启-rndu-rd时才有
+RnSigIndex sigIndex;                                                                           // <函数类型, 地址被获取的函数>, 开启-rndu-icall时才有
+std::set<const Function *> coldFuncs;                                                          // profile中冷的函数, 开启-rndu-pgo时才有
+RnPathTable pathTable;                                                                         // 结构体字段与数组元素的访问路径, 开启-rndu-field-paths时才有
+
+
+/* 基本块中按顺序出现的一次def或use, 用于到达定值分析 */
+struct RnDuEvent {
+  bool IsDef;
+  bool Strong;     // 覆盖整个变量(或确切的访问路径)的def, 会杀死之前的def; 数组元素, 字段与调用时传递指针的def只是弱更新
+  std::string Loc; // 所在的行
+  std::string Var; // 去掉.addr后的变量名, 或访问路径
+};
 
 
 namespace llvm {
@@ -55,7 +106,11 @@ namespace llvm {
       return "CFG for '" + F->getName().str() + "' function";
     }
 
-    std::string getNodeLabel(BasicBlock *Node, Function *Graph) {
+    std::string getNodeLabel(BasicBlock *Node, Function *) {
+      auto it = bbLabelMap.find(Node);
+      if (it != bbLabelMap.end())
+        return it->second;
+
       if (!Node->getName().empty()) {
         return Node->getName().str();
       }
@@ -66,6 +121,14 @@ namespace llvm {
       Node->printAsOperand(OS, false);
       return OS.str();
     }
+
+    template <typename EdgeIter>
+    std::string getEdgeAttributes(BasicBlock *Node, EdgeIter I, Function *) {
+      auto it = edgeCostMap.find(std::make_pair(Node, *I));
+      if (it == edgeCostMap.end())
+        return "";
+      return "rncost=" + std::to_string(it->second);
+    }
   };
 } // namespace llvm
 
@@ -77,6 +140,8 @@ namespace {
     RnDuPass()
         : ModulePass(ID) {}
 
+    void getAnalysisUsage(AnalysisUsage &AU) const override;
+    void computeEdgeCosts(Function &F, bool Cold);
     bool runOnModule(Module &M) override;
   };
 } // namespace
@@ -124,6 +189,17 @@ static void getDebugLoc(const Instruction *I, std::string &Filename, unsigned &L
 }
 
 
+/**
+ * @brief 调用点可能调用的函数, 开启-rndu-icall时包括间接调用的候选
+ *
+ * @param CB
+ * @param Callees
+ */
+static void getCallees(const CallBase &CB, SmallVectorImpl<const Function *> &Callees) {
+  getRnCallees(CB, DuICall ? &sigIndex : nullptr, DuICallMaxFanout, Callees);
+}
+
+
 /**
  * @brief Blacklist
  *
@@ -232,6 +308,339 @@ static void fsearchCall(Instruction::op_iterator op, std::string &varName, std::
 }
 
 
+/**
+ * @brief 概要分析时使用: 沿着指针的计算过程最多向前找几步获得变量名, 代价与函数规模无关
+ *
+ * @param V
+ * @return std::string 获取不到时为空
+ */
+static std::string csearchVar(Value *V) {
+  for (int depth = 0; V && depth < 8; depth++) {
+    V = V->stripPointerCasts();
+    if (isa<GlobalVariable>(V) || isa<AllocaInst>(V) || isa<Argument>(V))
+      return V->getName().str();
+
+    if (auto *GEP = dyn_cast<GetElementPtrInst>(V))
+      V = GEP->getPointerOperand();
+    else if (auto *LInst = dyn_cast<LoadInst>(V))
+      V = LInst->getPointerOperand();
+    else if (auto *Inst = dyn_cast<Instruction>(V))
+      V = Inst->getNumOperands() ? Inst->getOperand(0) : nullptr;
+    else
+      break;
+  }
+  return "";
+}
+
+
+/**
+ * @brief store是否覆盖整个变量: 地址直接是alloca或全局变量, 且写入的是与变量类型相同的标量.
+ *        数组元素, 结构体字段以及通过指针的写入只覆盖一部分(或不确定的位置), 到达定值分析中不杀死之前的def
+ *
+ * @param SI
+ * @return true
+ * @return false
+ */
+static bool isWholeVarStore(StoreInst *SI) {
+  Value *Ptr = SI->getPointerOperand();
+  Type *ValTy = SI->getValueOperand()->getType();
+  if (ValTy->isAggregateType() || ValTy->isVectorTy())
+    return false;
+  if (auto *AI = dyn_cast<AllocaInst>(Ptr))
+    return !AI->isArrayAllocation() && AI->getAllocatedType() == ValTy;
+  if (auto *GV = dyn_cast<GlobalVariable>(Ptr))
+    return GV->getValueType() == ValTy;
+  return false;
+}
+
+
+/**
+ * @brief 开启-rndu-field-paths时获取操作数的访问路径名
+ *
+ * @param V
+ * @param IsAddress true: V是被读写的地址, 取其指向的位置; false: V是值, load得到的值取被读取的位置, 指针(形参除外)取其指向的位置
+ * @param varName 获取到时写入访问路径名
+ * @param Exact 不为空且V是地址时写入路径是否确切, 见getRnAccessPath
+ * @return true
+ * @return false 无法获取, 此时仍使用向前搜索得到的变量名
+ */
+static bool getPathName(Value *V, bool IsAddress, std::string &varName, bool *Exact = nullptr) {
+  if (!DuFieldPaths)
+    return false;
+
+  int path = -1;
+  if (IsAddress)
+    path = getRnAccessPath(pathTable, V, DuFieldDepth, Exact);
+  else if (auto *LInst = dyn_cast<LoadInst>(V))
+    path = getRnAccessPath(pathTable, LInst->getPointerOperand(), DuFieldDepth);
+  else if (V->getType()->isPointerTy() && !isa<Argument>(V)) // 形参的值存入.addr时不是use
+    path = getRnAccessPath(pathTable, V, DuFieldDepth);
+  if (path < 0)
+    return false;
+
+  varName = pathTable.getName(path);
+  return true;
+}
+
+
+/**
+ * @brief 开启-rndu-weighted时需要每个函数的执行频率, 开启-rndu-pgo时需要模块的profile summary
+ *
+ * @param AU
+ */
+void RnDuPass::getAnalysisUsage(AnalysisUsage &AU) const {
+  if (DuPGO)
+    AU.addRequired<ProfileSummaryInfoWrapperPass>();
+  if (DuWeighted) {
+    AU.addRequired<BlockFrequencyInfoWrapperPass>();
+    AU.addRequired<BranchProbabilityInfoWrapperPass>();
+  }
+}
+
+
+/**
+ * @brief 按执行频率计算函数中每条cfg边的代价: 1 + log2(入口频率 / 边的频率), 边的频率不低于入口频率时为1
+ *
+ * 边的频率 = 起点的频率 * 分支概率, 由BFI与BPI得到. 循环的回边与出口边的频率都不低于入口频率, 代价为1,
+ * 只有进入比"每次调用执行一次"更少执行的区域(如错误处理分支)时代价才会变大.
+ * 用-fprofile-instr-use编译时BFI与BPI来自profile中的实际执行次数; profile中冷的函数所有边的代价都为上限
+ *
+ * @param F
+ * @param Cold 函数是否冷
+ */
+void RnDuPass::computeEdgeCosts(Function &F, bool Cold) {
+  if (Cold) {
+    for (auto &BB : F) {
+      for (BasicBlock *Succ : successors(&BB))
+        edgeCostMap[std::make_pair(&BB, Succ)] = DuWeightedMaxCost;
+    }
+    return;
+  }
+
+  BlockFrequencyInfo &BFI = getAnalysis<BlockFrequencyInfoWrapperPass>(F).getBFI();
+  BranchProbabilityInfo &BPI = getAnalysis<BranchProbabilityInfoWrapperPass>(F).getBPI();
+  double entryFreq = BFI.getEntryFreq();
+
+  for (auto &BB : F) {
+    double freq = BFI.getBlockFreq(&BB).getFrequency();
+    for (BasicBlock *Succ : successors(&BB)) {
+      BranchProbability prob = BPI.getEdgeProbability(&BB, Succ);
+      double edgeFreq = freq * prob.getNumerator() / prob.getDenominator();
+
+      unsigned cost = DuWeightedMaxCost;
+      if (edgeFreq > 0)
+        cost = 1 + (unsigned)std::max(0L, std::lround(std::log2(entryFreq / edgeFreq)));
+      edgeCostMap[std::make_pair(&BB, Succ)] = std::min<unsigned>(cost, DuWeightedMaxCost);
+    }
+  }
+}
+
+
+/**
+ * @brief 在过程间cfg上以目标基本块为起点反向执行Dijkstra, 得到每个基本块到最近的目标的加权距离
+ *
+ * 边为cfg中的边(代价来自edgeCostMap)以及调用点所在基本块到被调用函数入口的边(代价为1, 被调用函数冷时为上限)
+ *
+ * @param Funcs 有cfg的函数
+ * @param Targets 目标基本块
+ * @param Dist <基本块名字, 距离>, 同名基本块取最小值
+ */
+static void computeWeightedDist(const std::vector<Function *> &Funcs, const std::set<const BasicBlock *> &Targets,
+                                std::map<std::string, unsigned> &Dist) {
+  typedef std::pair<unsigned, const BasicBlock *> DistNode;
+  std::set<const Function *> funcSet(Funcs.begin(), Funcs.end());
+  std::map<const BasicBlock *, std::vector<std::pair<const BasicBlock *, unsigned>>> preds;
+  SmallVector<const Function *, 8> calledFs;
+
+  for (Function *F : Funcs) {
+    for (auto &BB : *F) {
+      for (const BasicBlock *Succ : successors(&BB)) {
+        auto it = edgeCostMap.find(std::make_pair(&BB, Succ));
+        preds[Succ].emplace_back(&BB, it != edgeCostMap.end() ? it->second : 1);
+      }
+      for (auto &I : BB) {
+        auto *CB = dyn_cast<CallBase>(&I);
+        if (!CB)
+          continue;
+        getCallees(*CB, calledFs);
+        for (const Function *CalledF : calledFs) {
+          if (funcSet.count(CalledF))
+            preds[&CalledF->getEntryBlock()].emplace_back(&BB, coldFuncs.count(CalledF) ? (unsigned)DuWeightedMaxCost : 1);
+        }
+      }
+    }
+  }
+
+  std::map<const BasicBlock *, unsigned> dist;
+  std::priority_queue<DistNode, std::vector<DistNode>, std::greater<DistNode>> pq;
+  for (const BasicBlock *BB : Targets) {
+    dist[BB] = 0;
+    pq.emplace(0, BB);
+  }
+
+  while (!pq.empty()) {
+    DistNode top = pq.top();
+    pq.pop();
+    if (top.first > dist[top.second])
+      continue;
+
+    for (auto &pbu : preds[top.second]) {
+      unsigned d = top.first + pbu.second;
+      auto it = dist.find(pbu.first);
+      if (it == dist.end() || d < it->second) {
+        dist[pbu.first] = d;
+        pq.emplace(d, pbu.first);
+      }
+    }
+  }
+
+  for (auto &pbu : dist) {
+    auto it = bbLabelMap.find(pbu.first);
+    if (it == bbLabelMap.end())
+      continue;
+    std::string bbname = StringRef(it->second).rtrim(':').str();
+    auto dit = Dist.find(bbname);
+    if (dit == Dist.end() || pbu.second < dit->second)
+      Dist[bbname] = pbu.second;
+  }
+}
+
+
+/**
+ * @brief 函数内的到达定值分析: 每个基本块的gen/kill为位向量, 按逆后序维护工作表迭代到不动点,
+ * 再在每个基本块内按顺序得到到达每个use的def, 结果存入duEdgeMap
+ *
+ * @param F
+ * @param Events <基本块, 按顺序出现的def/use>
+ */
+static void solveReachingDefs(Function &F, const std::map<const BasicBlock *, std::vector<RnDuEvent>> &Events) {
+  /* 按基本块的顺序为每个def编号, 同一基本块中的def编号连续 */
+  std::vector<const RnDuEvent *> defs;
+  std::map<const BasicBlock *, unsigned> firstDef; // <基本块, 其第一个def的编号>
+  std::map<std::string, std::vector<unsigned>> varDefIds;
+  for (auto &BB : F) {
+    firstDef[&BB] = defs.size();
+    auto it = Events.find(&BB);
+    if (it == Events.end())
+      continue;
+    for (auto &E : it->second) {
+      if (E.IsDef) {
+        varDefIds[E.Var].push_back(defs.size());
+        defs.push_back(&E);
+      }
+    }
+  }
+  if (defs.empty())
+    return;
+
+  unsigned n = defs.size();
+  std::map<std::string, BitVector> varDefs; // <变量, 它的所有def>
+  for (auto &psv : varDefIds) {
+    BitVector &bv = varDefs[psv.first];
+    bv.resize(n);
+    for (unsigned d : psv.second)
+      bv.set(d);
+  }
+
+  /* 开启-rndu-field-paths时变量为访问路径: 对路径的def杀死该路径及其下级的def, 对路径的use看到该路径, 其上级与下级的def */
+  std::map<std::string, BitVector> killDefs, useDefs;
+  for (auto &BB : F) {
+    auto it = Events.find(&BB);
+    if (it == Events.end())
+      continue;
+    for (auto &E : it->second) {
+      if (killDefs.count(E.Var))
+        continue;
+      BitVector &kill = killDefs[E.Var], &use = useDefs[E.Var];
+      kill.resize(n);
+      use.resize(n);
+      int path = pathTable.find(E.Var);
+      for (auto &psb : varDefs) {
+        int defPath = path >= 0 && psb.first != E.Var ? pathTable.find(psb.first) : -1;
+        if (psb.first == E.Var || (defPath >= 0 && pathTable.isAncestor(path, defPath))) {
+          kill |= psb.second;
+          use |= psb.second;
+        } else if (defPath >= 0 && pathTable.isAncestor(defPath, path))
+          use |= psb.second;
+      }
+    }
+  }
+
+  /* 每个基本块的gen与kill, 基本块按逆后序编号 */
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  std::vector<const BasicBlock *> order(RPOT.begin(), RPOT.end());
+  std::map<const BasicBlock *, unsigned> rpoIdx;
+  for (unsigned i = 0; i < order.size(); i++)
+    rpoIdx[order[i]] = i;
+
+  std::vector<BitVector> gen(order.size(), BitVector(n)), kill(order.size(), BitVector(n));
+  std::vector<BitVector> in(order.size(), BitVector(n)), out(order.size(), BitVector(n));
+  for (unsigned i = 0; i < order.size(); i++) {
+    auto it = Events.find(order[i]);
+    if (it == Events.end())
+      continue;
+    unsigned d = firstDef[order[i]];
+    for (auto &E : it->second) {
+      if (!E.IsDef)
+        continue;
+      if (E.Strong) {
+        kill[i] |= killDefs[E.Var];
+        gen[i].reset(killDefs[E.Var]);
+      }
+      gen[i].set(d++);
+    }
+    out[i] = gen[i];
+  }
+
+  /* 工作表中总是先取逆后序最靠前的基本块, 无环时一遍即可收敛 */
+  std::set<unsigned> worklist;
+  for (unsigned i = 0; i < order.size(); i++)
+    worklist.insert(i);
+  while (!worklist.empty()) {
+    unsigned i = *worklist.begin();
+    worklist.erase(worklist.begin());
+
+    in[i].reset();
+    for (const BasicBlock *Pred : predecessors(order[i])) {
+      auto pit = rpoIdx.find(Pred);
+      if (pit != rpoIdx.end())
+        in[i] |= out[pit->second];
+    }
+
+    BitVector newOut = in[i];
+    newOut.reset(kill[i]);
+    newOut |= gen[i];
+    if (newOut == out[i])
+      continue;
+    out[i] = std::move(newOut);
+    for (const BasicBlock *Succ : successors(order[i]))
+      worklist.insert(rpoIdx[Succ]);
+  }
+
+  /* 在基本块内按顺序得到每个use的到达定值, 不可达的基本块入口处没有到达定值 */
+  for (auto &BB : F) {
+    auto it = Events.find(&BB);
+    if (it == Events.end())
+      continue;
+    auto rit = rpoIdx.find(&BB);
+    BitVector cur = rit != rpoIdx.end() ? in[rit->second] : BitVector(n);
+    unsigned d = firstDef[&BB];
+    for (auto &E : it->second) {
+      if (E.IsDef) {
+        if (E.Strong)
+          cur.reset(killDefs[E.Var]);
+        cur.set(d++);
+      } else {
+        for (unsigned r : useDefs[E.Var].set_bits()) {
+          if (cur.test(r))
+            duEdgeMap[defs[r]->Loc][E.Loc].insert(E.Var);
+        }
+      }
+    }
+  }
+}
+
+
 /**
  * @brief 重写runOnModule,在编译被测对象的过程中获取数据流图
  *
@@ -247,12 +656,101 @@ bool RnDuPass::runOnModule(Module &M) {
     errs() << "Could not create directory: " << outDirectory << "\n";
   }
 
-  /* Def-use */
+  /* 每个编译单元的输出文件名带有序号, 需要之后合并; LTO时整个程序只输出一份, 不带序号 */
+  std::string fileIdx;
+  if (!DuLTO) {
+    int idx = 0;
+    while (existsRnOutput(outDirectory + "/duVar" + std::to_string(idx) + ".json"))
+      idx++;
+    fileIdx = std::to_string(idx);
+  }
+
+  /* 打包输出时, 一个模块的所有cfg写入同一个文件 */
+  std::unique_ptr<RnPackWriter> pack;
+  if (DuPack)
+    pack.reset(new RnPackWriter(outDirectory + "/cfg" + fileIdx + ".rnpack", DuCompress));
+
+  /* 序列化好的cfg和json交给后台线程写入, 打包文件也只在后台线程上访问 */
+  RnAsyncWriter writer(DuWriteQueue);
+
+  /* 间接调用按函数类型查找候选的被调用函数 */
+  sigIndex.clear();
+  pathTable.clear();
+  if (DuICall)
+    buildRnSigIndex(M, sigIndex);
+
+  /* 输出函数的cfg */
+  auto emitCFG = [&](Function &F) {
+    std::string cfgData;
+    raw_string_ostream cfgOS(cfgData);
+    WriteGraph(cfgOS, &F, true);
+    cfgOS.flush();
+
+    if (pack) {
+      RnPackWriter *P = pack.get();
+      std::string FuncFile = getRnFuncFile(F), FuncName = F.getName().str();
+      writer.post([P, FuncFile, FuncName, cfgData = std::move(cfgData)]() { P->add("cfg", FuncFile, FuncName, cfgData); });
+      return;
+    }
+
+    writer.write(outDirectory + "/cfg." + F.getName().str() + ".dot", std::move(cfgData), DuCompress);
+  };
+
+  /* 指定污点源时, 只输出与污点源调用距离足够近的函数的图, 需要遍历完模块后才能确定 */
+  std::set<std::string> taints;
+  bool targeted = false;
+  if (!DuTaintFile.empty() && !DuLTO) { // 逐个编译单元分析时调用图不完整, 没有污点源的编译单元会不输出任何cfg
+    errs() << "-rndu-taint needs the whole program's call graph, ignored without -rndu-lto\n";
+  } else if (!DuTaintFile.empty()) {
+    if (readRnTaints(DuTaintFile, taints))
+      targeted = true;
+    else
+      errs() << "Could not read taint file: " << DuTaintFile << "\n";
+  }
+  std::set<const Function *> taintFuncs; // 包含污点源的函数
+  std::vector<Function *> cfgFuncs;      // 有cfg但还没有输出的函数
+
+  /* 加权距离的目标 */
+  std::set<std::string> distTargets;
+  if (DuWeighted && !DuDistTargets.empty() && !readRnTaints(DuDistTargets, distTargets))
+    errs() << "Could not read distance target file: " << DuDistTargets << "\n";
+  std::set<const BasicBlock *> distTargetBBs; // 包含目标的基本块
+  std::vector<Function *> distFuncs;          // 参与计算距离的函数
+
+  /* 记录def-use, 开启-rndu-rd时同时按顺序记录到所在基本块, 供到达定值分析使用 */
+  std::map<const BasicBlock *, std::vector<RnDuEvent>> duEvents;
+  auto addDU = [&](const BasicBlock *BB, const std::string &Loc, bool IsDef, const std::string &Var, bool Strong = false) {
+    duVarMap[Loc][IsDef ? "def" : "use"].insert(Var);
+    if (DuRD) {
+      std::string var = pathTable.find(Var) >= 0 ? Var : Var.substr(0, Var.find(".addr"));
+      duEvents[BB].push_back(RnDuEvent{IsDef, Strong, Loc, var});
+    }
+  };
+
+  /* 单个函数的分析预算, 超出时改为概要的def-use; 开启-rndu-pgo时profile中冷的函数也改为概要的def-use */
+  RnBudget budget(DuMaxInsts, DuMaxEdges, DuMaxMillis);
+  ProfileSummaryInfo *PSI = DuPGO ? &getAnalysis<ProfileSummaryInfoWrapperPass>().getPSI() : nullptr;
+  coldFuncs.clear();
+  if (PSI) {
+    for (auto &F : M) {
+      if (!F.isDeclaration() && isRnColdFunction(F, PSI))
+        coldFuncs.insert(&F);
+    }
+  }
+  std::vector<std::pair<std::string, std::string>> degradedFuncs; // <函数名, 超出的限制>
+
+  /* 一次遍历同时获取基本块名字, def-use, 函数调用信息, 并输出cfg */
   for (auto &F : M) {
 
     if (isBlacklisted(&F))
       continue;
 
+    size_t cfgEdges = 0;
+    for (auto &BB : F)
+      cfgEdges += succ_size(&BB);
+    bool degraded = budget.start(F, PSI) || budget.exceeded(cfgEdges);
+    bool hasBB = false;
+
     /* 获取函数的Param列表, 防止出现跨文件调用函数时参数丢失的问题 */
     std::vector<std::string> paramVec;
     bool hasEmptyParam = false;
@@ -294,7 +792,7 @@ bool RnDuPass::runOnModule(Module &M) {
         if (!filename.empty() && line) {
 
           if (bbname.empty()) { // 若基本块名字为空时, 设置基本块名字, 并将其加入到bbFuncMap
-            bbname = filename + ":" + std::to_string(line);
+            bbname = loc;
             bbFuncMap[bbname] = F.getName().str();
           }
 
@@ -303,23 +801,41 @@ bool RnDuPass::runOnModule(Module &M) {
             linebbMap[loc] = bbname;
           }
 
-          dbgLocMap[&I] = loc;
+          if (targeted && taints.count(loc))
+            taintFuncs.insert(&F);
+
+          if (distTargets.count(loc))
+            distTargetBBs.insert(&BB);
+
           maxLineMap[filename] = maxLineMap[filename] > line ? maxLineMap[filename] : line;
         } else
           continue;
 
-        /* 获取函数调用信息 */
+        /* 超出预算后剩下的指令只做概要分析 */
+        if (!degraded && budget.exceeded(cfgEdges))
+          degraded = true;
+
+        /* 获取函数调用信息, 开启-rndu-icall时间接调用的每个候选都记录一次 */
         if (auto *c = dyn_cast<CallInst>(&I)) {
-          if (auto *CalledF = c->getCalledFunction()) {
+          SmallVector<const Function *, 8> calledFs;
+          getCallees(*c, calledFs);
+          std::vector<std::set<std::string>> varVec;
+          for (const Function *CalledF : calledFs) {
             if (!isBlacklisted(CalledF)) {
 
-              /* 按顺序获得调用函数时其形参对应的变量 */
-              std::vector<std::set<std::string>> varVec;
-              for (auto op = I.op_begin(); op != I.op_end(); op++) {
-                std::set<std::string> vars; // 形参对应的变量可能是多个, 所以存到一个集合中
-                std::string varName("");
-                fsearchCall(op, varName, vars);
-                varVec.push_back(vars);
+              /* 按顺序获得调用函数时其形参对应的变量, 各候选共用 */
+              if (varVec.empty()) {
+                for (auto op = I.op_begin(); op != I.op_end(); op++) {
+                  std::set<std::string> vars; // 形参对应的变量可能是多个, 所以存到一个集合中
+                  std::string varName("");
+                  if (degraded) {
+                    varName = csearchVar(op->get());
+                    if (!varName.empty())
+                      vars.insert(varName.substr(0, varName.find(".addr")));
+                  } else
+                    fsearchCall(op, varName, vars);
+                  varVec.push_back(vars);
+                }
               }
 
               /* 将函数和其参数对应的信息写入map */
@@ -339,9 +855,17 @@ bool RnDuPass::runOnModule(Module &M) {
 
           case Instruction::Store: { // Store表示对内存有修改, 所以是def
 
-            std::vector<std::string> varNames; // 存储Store指令中变量出现的顺序
+            std::vector<std::string> varNames;                              // 存储Store指令中变量出现的顺序
+            bool strong = !degraded && isWholeVarStore(cast<StoreInst>(&I)); // 是否覆盖整个变量或整个访问路径
             for (auto op = I.op_begin(); op != I.op_end(); op++) {
-              fsearchVar(op, varName);
+              bool isAddress = op->getOperandNo() == 1, exact = false;
+              if (degraded)
+                varName = csearchVar(op->get());
+              else if (getPathName(op->get(), isAddress, varName, &exact)) {
+                if (isAddress)
+                  strong = exact && !cast<StoreInst>(&I)->getValueOperand()->getType()->isAggregateType();
+              } else
+                fsearchVar(op, varName);
               varNames.push_back(varName);
             }
 
@@ -349,26 +873,30 @@ bool RnDuPass::runOnModule(Module &M) {
             for (int i = 0; i < n - 1; i++) {
               if (varNames[i].empty()) // 若分析得到的变量名为空, 则不把空变量名存入map, 下同
                 continue;
-              duVarMap[dbgLocMap[&I]]["use"].insert(varNames[i]);
+              addDU(&BB, loc, false, varNames[i]);
             }
 
             if (varNames[n - 1].empty())
               break;
 
-            duVarMap[dbgLocMap[&I]]["def"].insert(varNames[n - 1]);
+            addDU(&BB, loc, true, varNames[n - 1], strong);
 
             break;
           }
 
           case Instruction::Load: { // load表示从内存中读取, 所以是use
 
-            for (auto op = I.op_begin(); op != I.op_end(); op++)
-              fsearchVar(op, varName);
+            for (auto op = I.op_begin(); op != I.op_end(); op++) {
+              if (degraded)
+                varName = csearchVar(op->get());
+              else if (!getPathName(op->get(), true, varName))
+                fsearchVar(op, varName);
+            }
 
             if (varName.empty())
               break;
 
-            duVarMap[dbgLocMap[&I]]["use"].insert(varName);
+            addDU(&BB, loc, false, varName);
 
             break;
           }
@@ -378,16 +906,22 @@ bool RnDuPass::runOnModule(Module &M) {
             Type *varType = I.getType();
 
             for (auto op = I.op_begin(); op != I.op_end(); op++) {
-              fsearchVar(op, varName, varType);
+              if (degraded) {
+                varName = csearchVar(op->get());
+                varType = op->get()->getType();
+              } else if (getPathName(op->get(), false, varName))
+                varType = op->get()->getType();
+              else
+                fsearchVar(op, varName, varType);
 
               if (varName.empty())
                 continue;
 
-              if (varType->isPointerTy()) { // 如果是指针传递, 则认为 def,use 都有
-                duVarMap[dbgLocMap[&I]]["def"].insert(varName);
-                duVarMap[dbgLocMap[&I]]["use"].insert(varName);
+              if (varType->isPointerTy()) { // 如果是指针传递, 则认为 def,use 都有, 先use再def
+                addDU(&BB, loc, false, varName);
+                addDU(&BB, loc, true, varName);
               } else {
-                duVarMap[dbgLocMap[&I]]["use"].insert(varName);
+                addDU(&BB, loc, false, varName);
               }
             }
 
@@ -395,19 +929,123 @@ bool RnDuPass::runOnModule(Module &M) {
           }
         }
       }
+
+      /* 设置基本块名称, 编译时丢弃了变量名的话setName不会生效, 此时cfg的标签从bbLabelMap获取 */
+      if (!bbname.empty()) {
+        BB.setName(bbname + ":");
+        bbLabelMap[&BB] = BB.hasName() ? BB.getName().str() : bbname + ":";
+        hasBB = true;
+      }
+    }
+
+    /* 记录超出预算的函数 */
+    if (degraded) {
+      NumDegradedFuncs++;
+      errs() << "Over budget, using coarse def-use for " << F.getName() << ": " << budget.reason() << "\n";
+      degradedFuncs.emplace_back(F.getName().str(), budget.reason());
+    }
+
+    /* 到达定值分析, 超出预算的函数只有概要的def-use, 不做分析 */
+    if (DuRD && !degraded)
+      solveReachingDefs(F, duEvents);
+    duEvents.clear();
+
+    if (hasBB) {
+
+      /* Get entry BB */
+      auto entryIt = bbLabelMap.find(&F.getEntryBlock());
+      funcEntryMap[F.getName().str()] = entryIt != bbLabelMap.end() ? entryIt->second : F.getEntryBlock().getName().str();
+
+      /* 按执行频率计算边的代价, 输出cfg时作为边的属性 */
+      if (DuWeighted) {
+        computeEdgeCosts(F, coldFuncs.count(&F));
+        distFuncs.push_back(&F);
+      }
+
+      /* Print CFG */
+      if (targeted)
+        cfgFuncs.push_back(&F);
+      else
+        emitCFG(F);
+    }
+  }
+
+  /* 只输出与污点源相关的函数 */
+  if (targeted) {
+    std::set<const Function *> targetFuncs;
+    getRnTargetFuncs(M, taintFuncs, DuTaintDist, targetFuncs, DuICall ? &sigIndex : nullptr, DuICallMaxFanout);
+    for (Function *F : cfgFuncs) {
+      if (targetFuncs.count(F))
+        emitCFG(*F);
+    }
+  }
+
+  /* 输出到目标的加权距离, 格式与parse.py输出的距离文件相同: 基本块名字,距离 */
+  if (!distTargetBBs.empty()) {
+    std::map<std::string, unsigned> dist;
+    computeWeightedDist(distFuncs, distTargetBBs, dist);
+
+    std::string distData;
+    raw_string_ostream distOS(distData);
+    for (auto &psu : dist)
+      distOS << psu.first << "," << psu.second << "\n";
+    distOS.flush();
+    writer.write(outDirectory + "/wdist" + fileIdx + ".cfg.txt", std::move(distData), DuCompress);
+  }
+
+  /* 输出超出预算的函数 */
+  if (!degradedFuncs.empty()) {
+    std::string degradedData;
+    raw_string_ostream degradedOS(degradedData);
+    for (auto &pss : degradedFuncs)
+      degradedOS << pss.first << "," << pss.second << "\n";
+    degradedOS.flush();
+    writer.write(outDirectory + "/degraded" + fileIdx + ".txt", std::move(degradedData), DuCompress);
+  }
+
+  /* 输出def行到use行的边: {def所在的行: {use所在的行: [变量]}} */
+  if (DuRD) {
+    std::string duEdgeData;
+    raw_string_ostream duEdgeJson(duEdgeData);
+    json::OStream duEdgeJ(duEdgeJson);
+    duEdgeJ.objectBegin();
+    for (auto &defIt : duEdgeMap) {
+      duEdgeJ.attributeBegin(defIt.first);
+      duEdgeJ.objectBegin();
+      for (auto &useIt : defIt.second) {
+        duEdgeJ.attributeBegin(useIt.first);
+        duEdgeJ.arrayBegin();
+        for (auto &var : useIt.second)
+          duEdgeJ.value(var);
+        duEdgeJ.arrayEnd();
+        duEdgeJ.attributeEnd();
+      }
+      duEdgeJ.objectEnd();
+      duEdgeJ.attributeEnd();
     }
+    duEdgeJ.objectEnd();
+    duEdgeJson.flush();
+    writer.write(outDirectory + "/duEdge" + fileIdx + ".json", std::move(duEdgeData), DuCompress);
   }
 
-  int fileIdx = 0;
-  for (;; fileIdx++) {
-    std::fstream tmpF(outDirectory + "/duVar" + std::to_string(fileIdx) + ".json");
-    if (!tmpF)
-      break;
+  /* 输出访问路径: {路径: 上一级路径}, 变量本身不输出 */
+  if (DuFieldPaths) {
+    std::string pathData;
+    raw_string_ostream pathJson(pathData);
+    json::OStream pathJ(pathJson);
+    pathJ.objectBegin();
+    for (uint32_t i = 0; i < pathTable.size(); i++) {
+      if (pathTable.getParent(i) != RnPathTable::NoParent)
+        pathJ.attribute(pathTable.getName(i), pathTable.getName(pathTable.getParent(i)));
+    }
+    pathJ.objectEnd();
+    pathJson.flush();
+    writer.write(outDirectory + "/accessPath" + fileIdx + ".json", std::move(pathData), DuCompress);
   }
 
   /* 将duVarMap转换为json并输出 */
-  std::error_code EC;
-  raw_fd_ostream duVarJson(outDirectory + "/duVar" + std::to_string(fileIdx) + ".json", EC, sys::fs::F_None);
+  std::string duVarData;
+  raw_string_ostream duVarJson(duVarData);
   json::OStream duVarJ(duVarJson);
   duVarJ.objectBegin();
   for (auto it = duVarMap.begin(); it != duVarMap.end(); it++) { // 遍历map并转换为json, llvm的json似乎不会自动格式化?
@@ -429,9 +1067,12 @@ bool RnDuPass::runOnModule(Module &M) {
     duVarJ.attributeEnd();
   }
   duVarJ.objectEnd();
+  duVarJson.flush();
+  writer.write(outDirectory + "/duVar" + fileIdx + ".json", std::move(duVarData), DuCompress);
 
   /* 将bbLineMap转为json并输出 */
-  raw_fd_ostream bbLineJson(outDirectory + "/bbLine" + std::to_string(fileIdx) + ".json", EC, sys::fs::F_None);
+  std::string bbLineData;
+  raw_string_ostream bbLineJson(bbLineData);
   json::OStream bbLineJ(bbLineJson);
   bbLineJ.objectBegin();
   for (auto it = bbLineMap.begin(); it != bbLineMap.end(); it++) {
@@ -443,9 +1084,12 @@ bool RnDuPass::runOnModule(Module &M) {
     bbLineJ.attributeEnd();
   }
   bbLineJ.objectEnd();
+  bbLineJson.flush();
+  writer.write(outDirectory + "/bbLine" + fileIdx + ".json", std::move(bbLineData), DuCompress);
 
   /* 将linebbMap转为json并输出 */
-  raw_fd_ostream linebbJson(outDirectory + "/linebb" + std::to_string(fileIdx) + ".json", EC, sys::fs::F_None);
+  std::string linebbData;
+  raw_string_ostream linebbJson(linebbData);
   json::OStream linebbJ(linebbJson);
   linebbJ.objectBegin();
   for (auto pss : linebbMap) {
@@ -454,9 +1098,12 @@ bool RnDuPass::runOnModule(Module &M) {
     linebbJ.attributeEnd();
   }
   linebbJ.objectEnd();
+  linebbJson.flush();
+  writer.write(outDirectory + "/linebb" + fileIdx + ".json", std::move(linebbData), DuCompress);
 
   /* 将maxLineMap转为json并输出 */
-  raw_fd_ostream maxLineJson(outDirectory + "/maxLine" + std::to_string(fileIdx) + ".json", EC, sys::fs::F_None);
+  std::string maxLineData;
+  raw_string_ostream maxLineJson(maxLineData);
   json::OStream maxLineJ(maxLineJson);
   maxLineJ.objectBegin();
   for (auto psi : maxLineMap) {
@@ -465,9 +1112,12 @@ bool RnDuPass::runOnModule(Module &M) {
     maxLineJ.attributeEnd();
   }
   maxLineJ.objectEnd();
+  maxLineJson.flush();
+  writer.write(outDirectory + "/maxLine" + fileIdx + ".json", std::move(maxLineData), DuCompress);
 
   /* 将funcParamMap转换为json并输出 */
-  raw_fd_ostream funcParamJson(outDirectory + "/funcParam" + std::to_string(fileIdx) + ".json", EC, sys::fs::F_None);
+  std::string funcParamData;
+  raw_string_ostream funcParamJson(funcParamData);
   json::OStream funcParamJ(funcParamJson);
   funcParamJ.objectBegin();
   for (auto it = funcParamMap.begin(); it != funcParamMap.end(); it++) {
@@ -479,9 +1129,12 @@ bool RnDuPass::runOnModule(Module &M) {
     funcParamJ.attributeEnd();
   }
   funcParamJ.objectEnd();
+  funcParamJson.flush();
+  writer.write(outDirectory + "/funcParam" + fileIdx + ".json", std::move(funcParamData), DuCompress);
 
   /* 将callArgsMap转换为json并输出 */
-  raw_fd_ostream callArgsJson(outDirectory + "/callArgs" + std::to_string(fileIdx) + ".json", EC, sys::fs::F_None);
+  std::string callArgsData;
+  raw_string_ostream callArgsJson(callArgsData);
   json::OStream callArgsJ(callArgsJson);
   callArgsJ.objectBegin();
   for (auto it = callArgsMap.begin(); it != callArgsMap.end(); it++) {
@@ -504,9 +1157,12 @@ bool RnDuPass::runOnModule(Module &M) {
     callArgsJ.attributeEnd();
   }
   callArgsJ.objectEnd();
+  callArgsJson.flush();
+  writer.write(outDirectory + "/callArgs" + fileIdx + ".json", std::move(callArgsData), DuCompress);
 
   /* 将bbFuncMap转换为json并输出 */
-  raw_fd_ostream bbFuncJson(outDirectory + "/bbFunc" + std::to_string(fileIdx) + ".json", EC, sys::fs::F_None);
+  std::string bbFuncData;
+  raw_string_ostream bbFuncJson(bbFuncData);
   json::OStream bbFuncJ(bbFuncJson);
   bbFuncJ.objectBegin();
   for (auto it = bbFuncMap.begin(); it != bbFuncMap.end(); it++) { // 遍历map并转换为json, llvm的json似乎不会自动格式化?
@@ -515,69 +1171,12 @@ bool RnDuPass::runOnModule(Module &M) {
     bbFuncJ.attributeEnd();
   }
   bbFuncJ.objectEnd();
-
-  /* CFG */
-  for (auto &F : M) {
-
-    bool hasBB = false;
-    if (isBlacklisted(&F))
-      continue;
-
-    for (auto &BB : F) {
-      std::string bbName("");
-      for (auto &I : BB) {
-        /* 跳过external libs */
-        std::string filename;
-        unsigned line;
-        getDebugLoc(&I, filename, line);
-        static const std::string Xlibs("/usr/");
-        if (!filename.compare(0, Xlibs.size(), Xlibs))
-          continue;
-
-        /* 仅保留文件名与行号 */
-        std::size_t found = filename.find_last_of("/\\");
-        if (found != std::string::npos)
-          filename = filename.substr(found + 1);
-
-        /* 设置基本块名称 */
-        if (bbName.empty() && !filename.empty() && line) {
-          bbName = filename + ":" + std::to_string(line);
-        }
-      }
-
-      /* 设置基本块名称 */
-      if (!bbName.empty()) {
-        BB.setName(bbName + ":");
-        if (!BB.hasName()) {
-          std::string newname = bbName + ":";
-          Twine t(newname);
-          SmallString<256> NameData;
-          StringRef NameRef = t.toStringRef(NameData);
-          MallocAllocator Allocator;
-          BB.setValueName(ValueName::Create(NameRef, Allocator));
-        }
-        hasBB = true;
-      }
-    }
-
-    if (hasBB) {
-
-      /* Get entry BB */
-      funcEntryMap[F.getName().str()] = F.getEntryBlock().getName().str();
-
-      /* Print CFG */
-      std::error_code EC;
-      std::string cfgFileName = outDirectory + "/cfg." + F.getName().str() + ".dot";
-      raw_fd_ostream cfg(cfgFileName, EC, sys::fs::F_None);
-      if (!EC) {
-        WriteGraph(cfg, &F, true);
-        cfg.close();
-      }
-    }
-  }
+  bbFuncJson.flush();
+  writer.write(outDirectory + "/bbFunc" + fileIdx + ".json", std::move(bbFuncData), DuCompress);
 
   /* 将funcEntryMap转换为json并输出 */
-  raw_fd_ostream funcEntryJson(outDirectory + "/funcEntry" + std::to_string(fileIdx) + ".json", EC, sys::fs::F_None);
+  std::string funcEntryData;
+  raw_string_ostream funcEntryJson(funcEntryData);
   json::OStream funcEntryJ(funcEntryJson);
   funcEntryJ.objectBegin();
   for (auto it = funcEntryMap.begin(); it != funcEntryMap.end(); it++) { // 遍历map并转换为json, llvm的json似乎不会自动格式化?
@@ -586,14 +1185,23 @@ bool RnDuPass::runOnModule(Module &M) {
     funcEntryJ.attributeEnd();
   }
   funcEntryJ.objectEnd();
+  funcEntryJson.flush();
+  writer.write(outDirectory + "/funcEntry" + fileIdx + ".json", std::move(funcEntryData), DuCompress);
 
+  writer.finish();
   return false;
 }
 
 
-/* 注册Pass */
+/* 注册Pass, 开启-rndu-lto时只在链接时对合并后的模块运行一次 */
 static void registerRnDuPass(const PassManagerBuilder &, legacy::PassManagerBase &PM) {
-  PM.add(new RnDuPass());
+  if (!DuLTO)
+    PM.add(new RnDuPass());
+}
+static void registerRnDuPassLTO(const PassManagerBuilder &, legacy::PassManagerBase &PM) {
+  if (DuLTO)
+    PM.add(new RnDuPass());
 }
 static RegisterStandardPasses RegisterRnDuPass(PassManagerBuilder::EP_OptimizerLast, registerRnDuPass);
-static RegisterStandardPasses RegisterRnDuPass0(PassManagerBuilder::EP_EnabledOnOptLevel0, registerRnDuPass);
\ No newline at end of file
+static RegisterStandardPasses RegisterRnDuPass0(PassManagerBuilder::EP_EnabledOnOptLevel0, registerRnDuPass);
+static RegisterStandardPasses RegisterRnDuPassLTO(PassManagerBuilder::EP_FullLinkTimeOptimizationLast, registerRnDuPassLTO);
\ No newline at end of file
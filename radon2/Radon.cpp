@@ -0,0 +1,355 @@
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+
+#include "RnDistTable.h"
+#include "RnHitRT.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "rnhit"
+
+STATISTIC(NumHitBBs, "Number of instrumented basic blocks");
+
+
+/* 命令行参数 */
+static cl::opt<std::string> HitTargetsFile(
+    "rnhit-targets",
+    cl::desc("Distance file (bb,dist per line, or the mydist.cfg.phf table) listing the basic blocks to instrument"),
+    cl::value_desc("mydist.cfg.txt"),
+    cl::init(""));
+
+
+namespace {
+  class RnHitPass : public ModulePass {
+  public:
+    static char ID;
+    RnHitPass()
+        : ModulePass(ID) {}
+
+    bool runOnModule(Module &M) override;
+  };
+} // namespace
+
+
+char RnHitPass::ID = 0;
+
+
+/**
+ * @brief 获取指令的所在位置:"文件名:行号"
+ *
+ * @param I
+ * @param Filename
+ * @param Line
+ */
+static void getDebugLoc(const Instruction *I, std::string &Filename, unsigned &Line) {
+#ifdef LLVM_OLD_DEBUG_API
+  DebugLoc Loc = I->getDebugLoc();
+  if (!Loc.isUnknown()) {
+    DILocation cDILoc(Loc.getAsMDNode(M.getContext()));
+    DILocation oDILoc = cDILoc.getOrigLocation();
+
+    Line = oDILoc.getLineNumber();
+    Filename = oDILoc.getFilename().str();
+
+    if (filename.empty()) {
+      Line = cDILoc.getLineNumber();
+      Filename = cDILoc.getFilename().str();
+    }
+  }
+#else
+  if (DILocation *Loc = I->getDebugLoc()) {
+    Line = Loc->getLine();
+    Filename = Loc->getFilename().str();
+
+    if (Filename.empty()) {
+      DILocation *oDILoc = Loc->getInlinedAt();
+      if (oDILoc) {
+        Line = oDILoc->getLine();
+        Filename = oDILoc->getFilename().str();
+      }
+    }
+  }
+#endif /* LLVM_OLD_DEBUG_API */
+}
+
+
+/**
+ * @brief Blacklist
+ *
+ * @param F
+ * @return true
+ * @return false
+ */
+static bool isBlacklisted(const Function *F) {
+  static const SmallVector<std::string, 8> Blacklist = {
+      "asan.",
+      "llvm.",
+      "sancov.",
+      "__ubsan_handle_",
+      "__rn_hit_",
+      "free",
+      "malloc",
+      "calloc",
+      "realloc"};
+
+  for (auto const &BlacklistFunc : Blacklist) {
+    if (F->getName().startswith(BlacklistFunc)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief 按照RnDuPass的规则获取基本块名字: 第一条有调试信息的指令的"文件名:行号"
+ *
+ * @param BB
+ * @return std::string 获取不到时为空
+ */
+static std::string getBBName(BasicBlock &BB) {
+  for (auto &I : BB) {
+    std::string filename;
+    unsigned line = 0;
+    getDebugLoc(&I, filename, line);
+    static const std::string Xlibs("/usr/");
+    if (!filename.compare(0, Xlibs.size(), Xlibs))
+      continue;
+
+    std::size_t found = filename.find_last_of("/\\");
+    if (found != std::string::npos)
+      filename = filename.substr(found + 1);
+
+    if (!filename.empty() && line)
+      return filename + ":" + std::to_string(line);
+  }
+  return "";
+}
+
+
+/**
+ * @brief 读取距离文件, 获得需要插桩的基本块名字及其计数下标.
+ *        下标只由距离文件决定, 各编译单元使用同一个文件时互不冲突: 距离表mydist.cfg.phf时为键所在的槽位,
+ *        文本文件时为名字在所有目标中的排序位置
+ *
+ * @param Path
+ * @param Targets <基本块名字, 计数下标>
+ * @return true 读取成功
+ * @return false 读取失败
+ */
+static bool readHitTargets(const std::string &Path, std::map<std::string, unsigned> &Targets) {
+  auto BufOrErr = MemoryBuffer::getFile(Path);
+  if (!BufOrErr)
+    return false;
+
+  struct rn_dist_table table;
+  StringRef data = (*BufOrErr)->getBuffer();
+  if (!rn_dist_table_init(&table, data.data(), data.size())) {
+    for (uint32_t i = 0; i < table.num_keys; i++)
+      Targets[rn_dist_table_key(&table, i)] = i;
+    return true;
+  }
+
+  std::ifstream in(Path);
+  if (!in)
+    return false;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    std::size_t found = line.find(',');
+    if (found != std::string::npos)
+      line = line.substr(0, found);
+    if (!line.empty())
+      Targets[line] = 0;
+  }
+
+  unsigned idx = 0;
+  for (auto &psu : Targets)
+    psu.second = idx++;
+  return true;
+}
+
+
+/**
+ * @brief 判断hitMap.txt是否属于本次构建: 第一行记录生成该文件时的距离文件内容的哈希.
+ *        下标只由距离文件决定, 距离文件相同时各编译单元写入的对应关系不会冲突
+ *
+ * @param Path
+ * @param Stamp 当前距离文件内容的哈希
+ * @param Exists 文件是否存在
+ * @return true 文件由同一个距离文件生成, 追加写入
+ * @return false 文件不存在, 或是之前的构建(或其他距离文件)留下的, 需要重写
+ */
+static bool isSameHitMap(const std::string &Path, uint64_t Stamp, bool &Exists) {
+  std::ifstream in(Path);
+  std::string line;
+  Exists = (bool)std::getline(in, line);
+  return Exists && line == "#targets," + utohexstr(Stamp);
+}
+
+
+/**
+ * @brief 在基本块开头插入计数代码:
+ *        p = __rn_hit_ptr; n = __rn_hit_left; if (!n) { p = __rn_hit_slow(); n = __rn_hit_left; }
+ *        __rn_hit_left = n - 1; p[idx]++;
+ *        快路径只有TLS的读写和一次非原子的自增, 不需要锁和原子操作
+ *
+ * @param BB
+ * @param Idx
+ * @param HitPtr
+ * @param HitLeft
+ * @param SlowF
+ */
+static void instrumentBB(BasicBlock &BB, unsigned Idx, GlobalVariable *HitPtr, GlobalVariable *HitLeft,
+                         FunctionCallee SlowF) {
+  LLVMContext &C = BB.getContext();
+  Type *CounterTy = Type::getInt32Ty(C);
+  PointerType *CounterPtrTy = PointerType::getUnqual(CounterTy);
+
+  Instruction *InsertPt = &*BB.getFirstInsertionPt();
+  IRBuilder<> IRB(InsertPt);
+
+  LoadInst *Ptr = IRB.CreateLoad(CounterPtrTy, HitPtr);
+  LoadInst *Left = IRB.CreateLoad(CounterTy, HitLeft);
+  Value *IsZero = IRB.CreateICmpEQ(Left, ConstantInt::get(CounterTy, 0));
+
+  /* 线程第一次命中时分配本线程的计数区域, 之后每隔一段命中次数刷新本线程的计数 */
+  MDNode *Weights = MDBuilder(C).createBranchWeights(1, 1 << 20);
+  Instruction *ThenTerm = SplitBlockAndInsertIfThen(IsZero, InsertPt, false, Weights);
+
+  IRBuilder<> ThenIRB(ThenTerm);
+  Value *NewPtr = ThenIRB.CreateCall(SlowF);
+  Value *NewLeft = ThenIRB.CreateLoad(CounterTy, HitLeft);
+
+  IRB.SetInsertPoint(InsertPt);
+  PHINode *Counters = IRB.CreatePHI(CounterPtrTy, 2);
+  Counters->addIncoming(Ptr, Ptr->getParent());
+  Counters->addIncoming(NewPtr, ThenTerm->getParent());
+  PHINode *Remain = IRB.CreatePHI(CounterTy, 2);
+  Remain->addIncoming(Left, Left->getParent());
+  Remain->addIncoming(NewLeft, ThenTerm->getParent());
+  IRB.CreateStore(IRB.CreateSub(Remain, ConstantInt::get(CounterTy, 1)), HitLeft);
+
+  Value *Slot = IRB.CreateConstInBoundsGEP1_32(CounterTy, Counters, Idx);
+  LoadInst *Count = IRB.CreateLoad(CounterTy, Slot);
+  IRB.CreateStore(IRB.CreateAdd(Count, ConstantInt::get(CounterTy, 1)), Slot);
+}
+
+
+/**
+ * @brief 重写runOnModule, 对距离文件中列出的基本块插桩, 记录运行时的命中次数
+ *
+ * @param M
+ * @return true
+ * @return false
+ */
+bool RnHitPass::runOnModule(Module &M) {
+
+  if (HitTargetsFile.empty())
+    return false;
+
+  std::map<std::string, unsigned> targets;
+  if (!readHitTargets(HitTargetsFile, targets)) {
+    errs() << "Could not read hit targets: " << HitTargetsFile << "\n";
+    return false;
+  }
+
+  /* 创建文件夹存储输出内容 */
+  std::string outDirectory = "./radon2/out-files";
+  if (sys::fs::create_directory(outDirectory)) {
+    errs() << "Could not create directory: " << outDirectory << "\n";
+  }
+
+  /* 先收集需要插桩的基本块, 插桩时会拆分基本块, 不能边遍历边修改 */
+  std::vector<std::pair<BasicBlock *, std::string>> hitBBs;
+  if (targets.size() > RN_HIT_MAP_SIZE)
+    errs() << "More hit targets (" << targets.size() << ") than counters (" << RN_HIT_MAP_SIZE
+           << "), blocks beyond them are not instrumented; rebuild with a larger RN_HIT_MAP_SIZE_POW2\n";
+  for (auto &F : M) {
+    if (F.isDeclaration() || isBlacklisted(&F))
+      continue;
+
+    for (auto &BB : F) {
+      std::string bbname = getBBName(BB);
+      if (!bbname.empty() && targets.count(bbname))
+        hitBBs.emplace_back(&BB, bbname);
+    }
+  }
+
+  if (hitBBs.empty())
+    return false;
+
+  /* 运行时库中的线程局部计数指针, 剩余命中次数与慢路径函数 */
+  LLVMContext &C = M.getContext();
+  Type *CounterTy = Type::getInt32Ty(C);
+  PointerType *CounterPtrTy = PointerType::getUnqual(CounterTy);
+
+  GlobalVariable *HitPtr = M.getGlobalVariable("__rn_hit_ptr");
+  if (!HitPtr)
+    HitPtr = new GlobalVariable(M, CounterPtrTy, false, GlobalValue::ExternalLinkage, nullptr, "__rn_hit_ptr",
+                                nullptr, GlobalVariable::InitialExecTLSModel);
+  GlobalVariable *HitLeft = M.getGlobalVariable("__rn_hit_left");
+  if (!HitLeft)
+    HitLeft = new GlobalVariable(M, CounterTy, false, GlobalValue::ExternalLinkage, nullptr, "__rn_hit_left",
+                                 nullptr, GlobalVariable::InitialExecTLSModel);
+  FunctionCallee SlowF = M.getOrInsertFunction("__rn_hit_slow", CounterPtrTy);
+
+  /* 基本块名字与计数下标的对应关系, 下标来自距离文件. 距离文件没有变化时追加, 否则(重新构建)重写hitMap.txt */
+  std::string hitMapPath = outDirectory + "/hitMap.txt";
+  uint64_t stamp = 0;
+  if (auto BufOrErr = MemoryBuffer::getFile(HitTargetsFile))
+    stamp = xxHash64((*BufOrErr)->getBuffer());
+  bool exists;
+  bool sameBuild = isSameHitMap(hitMapPath, stamp, exists);
+  if (!sameBuild && exists)
+    errs() << "Targets file changed, starting a new " << hitMapPath << "\n";
+  std::ofstream hitMap(hitMapPath, sameBuild ? std::ofstream::out | std::ofstream::app : std::ofstream::out);
+  if (!sameBuild)
+    hitMap << "#targets," << utohexstr(stamp) << "\n";
+
+  for (auto &pbs : hitBBs) {
+    unsigned idx = targets[pbs.second];
+    if (idx >= RN_HIT_MAP_SIZE)
+      continue;
+
+    instrumentBB(*pbs.first, idx, HitPtr, HitLeft, SlowF);
+    hitMap << pbs.second << "," << idx << "\n";
+    NumHitBBs++;
+  }
+
+  return true;
+}
+
+
+/* 注册Pass */
+static void registerRnHitPass(const PassManagerBuilder &, legacy::PassManagerBase &PM) {
+  PM.add(new RnHitPass());
+}
+static RegisterStandardPasses RegisterRnHitPass(PassManagerBuilder::EP_OptimizerLast, registerRnHitPass);
+static RegisterStandardPasses RegisterRnHitPass0(PassManagerBuilder::EP_EnabledOnOptLevel0, registerRnHitPass);
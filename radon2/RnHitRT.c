@@ -0,0 +1,224 @@
+/*
+ * RnHitPass的运行时库, 记录被插桩基本块的命中次数
+ *
+ * 每个线程第一次命中时分配一块按缓存行对齐的私有计数区域, 插桩代码只对本线程的区域做非原子自增.
+ * 私有计数只增不减, 每块区域另外记录已经累加到共享区域的部分, 刷新时只累加两者的差, 不会清零正在自增的计数:
+ *   - 每个线程每命中RN_HIT_FLUSH_INTERVAL次进入一次慢路径, 由该线程自己刷新, 运行期间共享区域就会逐步填充
+ *   - 线程退出, 进程退出或调用__rn_hit_flush()时刷新, 进程退出时其他线程的计数只读取不修改
+ *   - 信号处理函数中调用__rn_hit_flush_signal(), 不会因等待锁而死锁
+ * 共享区域:
+ *   - 设置了__RN_HIT_SHM_ID时, 共享区域是对应的共享内存 (System V, 与AFL的__AFL_SHM_ID用法相同)
+ *   - 否则使用进程内的静态区域, 设置了RN_HIT_OUT时在退出时把"下标,次数"写入该文件
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/shm.h>
+
+#include "RnHitRT.h"
+
+/* 插桩代码读取的线程局部指针, 为NULL时表示本线程还没有分配计数区域 */
+__thread uint32_t *__rn_hit_ptr __attribute__((tls_model("initial-exec")));
+
+/* 本线程距离下一次进入慢路径还剩的命中次数, 为0时进入慢路径 */
+__thread uint32_t __rn_hit_left __attribute__((tls_model("initial-exec")));
+
+/* 线程计数区域链表, 只在线程创建/退出和刷新时加锁, 不影响快路径 */
+struct rn_hit_area {
+  uint32_t counters[RN_HIT_MAP_SIZE];
+  uint32_t flushed[RN_HIT_MAP_SIZE]; // 已经累加到共享区域的计数
+  struct rn_hit_area *next;
+  struct rn_hit_area *prev;
+} __attribute__((aligned(RN_HIT_CACHE_LINE)));
+
+static struct rn_hit_area *rn_hit_areas;
+static pthread_mutex_t rn_hit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t rn_hit_local_map[RN_HIT_MAP_SIZE];
+static uint32_t *rn_hit_shared = rn_hit_local_map;
+
+static uint32_t rn_hit_interval = RN_HIT_FLUSH_INTERVAL;
+
+static pthread_key_t rn_hit_key;
+static pthread_once_t rn_hit_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * @brief 把一块私有计数中还没有累加的部分累加到共享区域, 调用时需要持有rn_hit_lock.
+ *        计数可能正在被所属的线程自增, 只读取, 不清零
+ *
+ * @param area
+ */
+static void rn_hit_flush_area(struct rn_hit_area *area) {
+  uint32_t i;
+  for (i = 0; i < RN_HIT_MAP_SIZE; i++) {
+    uint32_t cnt = __atomic_load_n(&area->counters[i], __ATOMIC_RELAXED);
+    uint32_t delta = cnt - area->flushed[i];
+    if (!delta)
+      continue;
+    __atomic_fetch_add(&rn_hit_shared[i], delta, __ATOMIC_RELAXED);
+    area->flushed[i] = cnt;
+  }
+}
+
+
+/**
+ * @brief 刷新所有线程的计数, 调用时需要持有rn_hit_lock
+ */
+static void rn_hit_flush_all(void) {
+  struct rn_hit_area *area;
+  for (area = rn_hit_areas; area; area = area->next)
+    rn_hit_flush_area(area);
+}
+
+
+/**
+ * @brief 线程退出时刷新并释放该线程的计数区域
+ *
+ * @param p
+ */
+static void rn_hit_thread_exit(void *p) {
+  struct rn_hit_area *area = (struct rn_hit_area *)p;
+
+  pthread_mutex_lock(&rn_hit_lock);
+  rn_hit_flush_area(area);
+  if (area->prev)
+    area->prev->next = area->next;
+  else
+    rn_hit_areas = area->next;
+  if (area->next)
+    area->next->prev = area->prev;
+  pthread_mutex_unlock(&rn_hit_lock);
+
+  __rn_hit_ptr = NULL;
+  free(area);
+}
+
+
+/**
+ * @brief 进程退出时刷新所有线程的计数, 必要时输出文本结果
+ */
+static void rn_hit_process_exit(void) {
+  const char *out;
+
+  pthread_mutex_lock(&rn_hit_lock);
+  rn_hit_flush_all();
+  pthread_mutex_unlock(&rn_hit_lock);
+
+  out = getenv(RN_HIT_OUT_ENV_VAR);
+  if (out && *out) {
+    FILE *f = fopen(out, "w");
+    uint32_t i;
+    if (!f)
+      return;
+    for (i = 0; i < RN_HIT_MAP_SIZE; i++) {
+      if (rn_hit_shared[i])
+        fprintf(f, "%u,%u\n", i, rn_hit_shared[i]);
+    }
+    fclose(f);
+  }
+}
+
+
+/**
+ * @brief fork之后子进程中只剩调用fork的线程, 其他线程的计数区域不再有所属的线程, 直接丢弃;
+ *        它们在fork之前的计数由父进程刷新
+ */
+static void rn_hit_fork_child(void) {
+  struct rn_hit_area *self = (struct rn_hit_area *)pthread_getspecific(rn_hit_key);
+
+  pthread_mutex_init(&rn_hit_lock, NULL);
+  rn_hit_areas = self;
+  if (self)
+    self->next = self->prev = NULL;
+}
+
+
+/**
+ * @brief 初始化运行时: 线程退出回调, 进程退出回调, fork回调, 共享内存, 刷新间隔
+ */
+static void rn_hit_setup(void) {
+  const char *id = getenv(RN_HIT_SHM_ENV_VAR);
+  const char *interval = getenv(RN_HIT_INTERVAL_ENV_VAR);
+
+  pthread_key_create(&rn_hit_key, rn_hit_thread_exit);
+  atexit(rn_hit_process_exit);
+  pthread_atfork(NULL, NULL, rn_hit_fork_child);
+
+  if (id && *id) {
+    void *shm = shmat(atoi(id), NULL, 0);
+    if (shm != (void *)-1)
+      rn_hit_shared = (uint32_t *)shm;
+  }
+
+  if (interval && atoi(interval) > 0)
+    rn_hit_interval = (uint32_t)atoi(interval);
+}
+
+
+__attribute__((constructor)) static void rn_hit_init(void) {
+  pthread_once(&rn_hit_once, rn_hit_setup);
+}
+
+
+/**
+ * @brief 慢路径: 线程第一次命中时分配计数区域, 之后每RN_HIT_FLUSH_INTERVAL次命中刷新一次本线程的计数
+ *
+ * @return uint32_t* 当前线程的计数区域
+ */
+uint32_t *__rn_hit_slow(void) {
+  struct rn_hit_area *area;
+
+  if (__rn_hit_ptr) {
+    __rn_hit_left = rn_hit_interval;
+    area = (struct rn_hit_area *)pthread_getspecific(rn_hit_key);
+    pthread_mutex_lock(&rn_hit_lock);
+    rn_hit_flush_area(area);
+    pthread_mutex_unlock(&rn_hit_lock);
+    return __rn_hit_ptr;
+  }
+
+  pthread_once(&rn_hit_once, rn_hit_setup);
+  __rn_hit_left = rn_hit_interval;
+
+  if (posix_memalign((void **)&area, RN_HIT_CACHE_LINE, sizeof(*area)))
+    abort();
+  memset(area, 0, sizeof(*area));
+
+  pthread_mutex_lock(&rn_hit_lock);
+  area->next = rn_hit_areas;
+  if (rn_hit_areas)
+    rn_hit_areas->prev = area;
+  rn_hit_areas = area;
+  pthread_mutex_unlock(&rn_hit_lock);
+
+  pthread_setspecific(rn_hit_key, area);
+  __rn_hit_ptr = area->counters;
+  return area->counters;
+}
+
+
+/**
+ * @brief 立即刷新所有线程的计数, 供fork server等在报告结果前主动调用
+ */
+void __rn_hit_flush(void) {
+  pthread_mutex_lock(&rn_hit_lock);
+  rn_hit_flush_all();
+  pthread_mutex_unlock(&rn_hit_lock);
+}
+
+
+/**
+ * @brief 供信号处理函数(如SIGSEGV, SIGABRT)调用的刷新: 只用原子操作, 锁被占用时(例如被中断的线程正在刷新)直接返回
+ *
+ * @return int 0为已刷新, -1为锁被占用
+ */
+int __rn_hit_flush_signal(void) {
+  if (pthread_mutex_trylock(&rn_hit_lock))
+    return -1;
+  rn_hit_flush_all();
+  pthread_mutex_unlock(&rn_hit_lock);
+  return 0;
+}
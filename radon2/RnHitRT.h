@@ -0,0 +1,39 @@
+/*
+ * RnHitPass与运行时库共用的常量
+ *
+ * 计数下标由距离文件中基本块的位置得到, 各基本块的下标互不相同, 共享内存区域的大小为RN_HIT_MAP_SIZE个uint32_t.
+ * 目标基本块多于RN_HIT_MAP_SIZE时, 构建时用-DRN_HIT_MAP_SIZE_POW2=<n>增大, 插桩与运行时库需要使用相同的值
+ */
+#ifndef RN_HIT_RT_H
+#define RN_HIT_RT_H
+
+#ifndef RN_HIT_MAP_SIZE_POW2
+#define RN_HIT_MAP_SIZE_POW2 16
+#endif
+
+#define RN_HIT_MAP_SIZE (1U << RN_HIT_MAP_SIZE_POW2)
+
+/* 每个线程每命中这么多次刷新一次本线程的计数, 运行时可以用RN_HIT_FLUSH_INTERVAL环境变量修改 */
+#ifndef RN_HIT_FLUSH_INTERVAL
+#define RN_HIT_FLUSH_INTERVAL (1U << 16)
+#endif
+
+/* 计数区域按缓存行对齐, 保证不同线程的计数不会落在同一个缓存行里 */
+#define RN_HIT_CACHE_LINE 64
+
+/* 共享内存id, 文本输出路径与刷新间隔的环境变量 */
+#define RN_HIT_SHM_ENV_VAR "__RN_HIT_SHM_ID"
+#define RN_HIT_OUT_ENV_VAR "RN_HIT_OUT"
+#define RN_HIT_INTERVAL_ENV_VAR "RN_HIT_FLUSH_INTERVAL"
+
+/* 被测对象可以调用的刷新函数: fork server在报告结果前调用前者, 信号处理函数中调用后者 */
+#ifdef __cplusplus
+extern "C" {
+#endif
+void __rn_hit_flush(void);
+int __rn_hit_flush_signal(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RN_HIT_RT_H */
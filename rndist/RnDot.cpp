@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifdef RN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "RnDot.h"
+
+using namespace llvm;
+
+
+/* 一个读取任务: 一个dot文件, 或打包文件中的一个cfg */
+struct RnLoadTask {
+  std::string Path;
+  bool Gz = false;
+  bool Packed = false;
+  uint64_t Offset = 0;
+  uint64_t Size = 0;
+  std::string File;
+  std::string Func;
+};
+
+
+static bool isIdentChar(char C) {
+  return isAlnum(C) || C == '_' || C == '.';
+}
+
+
+/**
+ * @brief 解压gzip格式的数据, 支持多个gzip成员首尾相接
+ *
+ * @param In
+ * @param Out
+ * @return true
+ * @return false
+ */
+static bool gunzipRn(StringRef In, std::string &Out) {
+#ifdef RN_HAVE_ZLIB
+  z_stream strm = {};
+  if (inflateInit2(&strm, 15 + 32) != Z_OK) // windowBits + 32: 自动识别gzip头
+    return false;
+
+  char chunk[1 << 16];
+  strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(In.data()));
+  strm.avail_in = In.size();
+  int ret = Z_OK;
+  while (ret != Z_STREAM_END || strm.avail_in) {
+    if (ret == Z_STREAM_END)
+      inflateReset(&strm); // 下一个gzip成员
+
+    strm.next_out = reinterpret_cast<Bytef *>(chunk);
+    strm.avail_out = sizeof(chunk);
+    ret = inflate(&strm, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END) {
+      inflateEnd(&strm);
+      return false;
+    }
+    Out.append(chunk, sizeof(chunk) - strm.avail_out);
+  }
+  inflateEnd(&strm);
+  return true;
+#else
+  errs() << "Built without zlib, cannot read compressed cfg\n";
+  return false;
+#endif
+}
+
+
+/**
+ * @brief 读取RnDuPass输出的文件, 文件不存在时尝试读取压缩后的"<Path>.gz"
+ *
+ * @param Path
+ * @param Data
+ * @return true
+ * @return false 两者都无法读取
+ */
+bool readRnArtifact(const std::string &Path, std::string &Data) {
+  Data.clear();
+  if (auto BufOrErr = MemoryBuffer::getFile(Path)) {
+    Data = (*BufOrErr)->getBuffer().str();
+    return true;
+  }
+  auto BufOrErr = MemoryBuffer::getFile(Path + ".gz");
+  return BufOrErr && gunzipRn((*BufOrErr)->getBuffer(), Data);
+}
+
+
+/**
+ * @brief 读取一个任务对应的dot数据, 未压缩时直接使用文件的缓冲区, 不再拷贝
+ *
+ * @param Task
+ * @param Buf 文件的缓冲区
+ * @param Unzipped 解压后的数据
+ * @param Data 指向Buf或Unzipped
+ * @return true
+ * @return false
+ */
+static bool readRnTask(const RnLoadTask &Task, std::unique_ptr<MemoryBuffer> &Buf, std::string &Unzipped, StringRef &Data) {
+  auto BufOrErr = Task.Packed ? MemoryBuffer::getFileSlice(Task.Path, Task.Size, Task.Offset) : MemoryBuffer::getFile(Task.Path);
+  if (!BufOrErr)
+    return false;
+  Buf = std::move(*BufOrErr);
+
+  Data = Buf->getBuffer();
+  if (!Task.Gz)
+    return true;
+
+  Unzipped.clear();
+  if (!gunzipRn(Data, Unzipped))
+    return false;
+  Data = Unzipped;
+  return true;
+}
+
+
+/**
+ * @brief 读取打包文件的索引, 为其中的每个cfg生成一个读取任务
+ *
+ * @param Path
+ * @param Tasks
+ * @return true
+ * @return false
+ */
+static bool readRnPackIndex(const std::string &Path, std::vector<RnLoadTask> &Tasks) {
+  uint64_t fileSize;
+  if (sys::fs::file_size(Path, fileSize) || fileSize < 24)
+    return false;
+
+  auto FooterOrErr = MemoryBuffer::getFileSlice(Path, 24, fileSize - 24);
+  if (!FooterOrErr)
+    return false;
+  const char *footer = (*FooterOrErr)->getBufferStart();
+  if (StringRef(footer, 8) != "RNPACK01")
+    return false;
+
+  uint64_t indexOffset = support::endian::read64le(footer + 8);
+  uint64_t indexSize = support::endian::read64le(footer + 16);
+  auto IndexOrErr = MemoryBuffer::getFileSlice(Path, indexSize, indexOffset);
+  if (!IndexOrErr)
+    return false;
+
+  SmallVector<StringRef, 8> lines, fields;
+  (*IndexOrErr)->getBuffer().split(lines, '\n', -1, false);
+  for (StringRef line : lines) {
+    fields.clear();
+    line.split(fields, '\t');
+    if (fields.size() != 6 || fields[0] != "cfg")
+      continue;
+
+    RnLoadTask task;
+    task.Path = Path;
+    task.Packed = true;
+    task.File = fields[1].str();
+    task.Func = fields[2].str();
+    if (fields[3].getAsInteger(10, task.Offset) || fields[4].getAsInteger(10, task.Size))
+      return false;
+    task.Gz = fields[5] == "gz";
+    Tasks.push_back(std::move(task));
+  }
+  return true;
+}
+
+
+/**
+ * @brief 由节点标签获得基本块名字, 与parse.py的规则一致: 去掉末尾的":", 最多保留"文件名:行号"两段
+ *
+ * @param Label
+ * @return std::string
+ */
+std::string getRnBBName(StringRef Label) {
+  Label = Label.ltrim("\"{").rtrim(":}\"");
+
+  size_t first = Label.find(':');
+  if (first == StringRef::npos)
+    return Label.str();
+  size_t second = Label.find(':', first + 1);
+  return Label.substr(0, second).str();
+}
+
+
+/**
+ * @brief 解析节点属性中的label, 只保留记录的第一个字段, 例如"{t.c:2:|{<s0>T|<s1>F}}"得到"t.c:2:"
+ *
+ * @param Attrs 节点名之后的属性列表
+ * @return std::string
+ */
+static std::string parseRnLabel(StringRef Attrs) {
+  size_t pos = Attrs.find("label=\"");
+  if (pos == StringRef::npos)
+    return "";
+
+  std::string label;
+  int depth = 0;
+  for (size_t i = pos + 7; i < Attrs.size(); i++) {
+    char c = Attrs[i];
+    if (c == '\\' && i + 1 < Attrs.size()) {
+      c = Attrs[++i];
+      if (c == 'l' || c == 'n' || c == 'r') // 记录中的换行
+        continue;
+      label.push_back(c);
+    } else if (c == '"') {
+      break;
+    } else if (c == '{') {
+      if (depth++ > 0)
+        break;
+    } else if (c == '}' || c == '|') {
+      break;
+    } else {
+      label.push_back(c);
+    }
+  }
+  return label;
+}
+
+
+/**
+ * @brief 解析一个dot格式的cfg
+ *
+ * @param Data
+ * @param Cfg
+ * @return true 解析成功
+ * @return false 不是WriteGraph输出的格式
+ */
+bool parseRnCfg(StringRef Data, RnCfg &Cfg) {
+  std::vector<std::pair<StringRef, std::string>> nodeStmts; // <节点名, 标签>
+  std::vector<std::pair<StringRef, StringRef>> edgeStmts;
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  std::vector<uint32_t> costs; // <边, rncost>
+  bool hasHeader = false, weighted = false;
+
+  auto getId = [&](StringRef Name) {
+    auto res = Cfg.NameIds.insert(std::make_pair(Name, (uint32_t)Cfg.Labels.size()));
+    if (res.second) {
+      Cfg.Labels.emplace_back();
+      Cfg.Names.push_back(Name.str());
+    }
+    return res.first->second;
+  };
+
+  while (!Data.empty()) {
+    StringRef line;
+    std::tie(line, Data) = Data.split('\n');
+    line = line.trim();
+    if (line.empty() || line == "}")
+      continue;
+
+    /* digraph "CFG for 'main' function" { */
+    if (line.startswith("digraph")) {
+      size_t begin = line.find("'"), end = line.rfind("'");
+      if (begin != StringRef::npos && end > begin && Cfg.Func.empty())
+        Cfg.Func = line.slice(begin + 1, end).str();
+      hasHeader = true;
+      continue;
+    }
+    if (!hasHeader)
+      return false;
+
+    /* Node0x59af6a0 [shape=record,label="{t.c:2:}"]; 或 Node0x59af6a0:s0 -> Node0x59b0740; */
+    StringRef src = line.take_while(isIdentChar);
+    if (src.empty() || !src.startswith("Node"))
+      continue; // 图的属性
+    StringRef rest = line.drop_front(src.size());
+    if (rest.consume_front(":"))
+      rest = rest.drop_while(isIdentChar); // 边的起点端口
+    rest = rest.ltrim();
+
+    if (rest.consume_front("->")) {
+      StringRef dst = rest.ltrim().take_while(isIdentChar);
+      if (dst.empty())
+        return false;
+      edgeStmts.emplace_back(src, dst);
+
+      /* -rndu-weighted输出的边的代价 */
+      uint32_t cost = 1;
+      size_t pos = rest.find("rncost=");
+      if (pos != StringRef::npos) {
+        rest.drop_front(pos + 7).take_while(isDigit).getAsInteger(10, cost);
+        weighted = true;
+      }
+      costs.push_back(cost);
+    } else if (rest.startswith("[")) {
+      nodeStmts.emplace_back(src, parseRnLabel(rest));
+    }
+  }
+  if (!hasHeader)
+    return false;
+
+  /* 节点按节点语句的顺序编号(与pydot的get_nodes一致), 只出现在边中的节点排在最后 */
+  for (auto &n : nodeStmts)
+    Cfg.Labels[getId(n.first)] = std::move(n.second);
+  for (auto &e : edgeStmts) {
+    uint32_t srcId = getId(e.first);
+    edges.emplace_back(srcId, getId(e.second));
+  }
+
+  for (uint32_t i = 0; i < Cfg.Labels.size(); i++)
+    Cfg.LabelIds.insert(std::make_pair(Cfg.Labels[i], i));
+
+  /* 按起点计数排序, 生成CSR, 同一起点的边保持在文件中的顺序 */
+  Cfg.Offsets.assign(Cfg.Labels.size() + 1, 0);
+  for (auto &e : edges)
+    Cfg.Offsets[e.first + 1]++;
+  for (size_t i = 1; i < Cfg.Offsets.size(); i++)
+    Cfg.Offsets[i] += Cfg.Offsets[i - 1];
+
+  Cfg.Succs.resize(edges.size());
+  if (weighted)
+    Cfg.Costs.resize(edges.size());
+  std::vector<uint32_t> fill(Cfg.Offsets.begin(), Cfg.Offsets.end() - 1);
+  for (size_t i = 0; i < edges.size(); i++) {
+    uint32_t e = fill[edges[i].first]++;
+    Cfg.Succs[e] = edges[i].second;
+    if (weighted)
+      Cfg.Costs[e] = costs[i];
+  }
+  return true;
+}
+
+
+/**
+ * @brief 读取目录下的所有cfg: cfg.<函数名>.dot, 压缩后的cfg.<函数名>.dot.gz, 以及打包文件*.rnpack中的cfg
+ *
+ * @param Dir
+ * @param Jobs 线程数, 为0时使用所有核心
+ * @param Cfgs 按文件名排序, 打包文件中的cfg按索引顺序排在其后
+ * @return true
+ * @return false 目录无法读取
+ */
+bool loadRnCfgDir(const std::string &Dir, unsigned Jobs, std::vector<RnCfg> &Cfgs) {
+  /* 列出所有文件 */
+  std::vector<std::string> dots, packs;
+  std::error_code EC;
+  for (sys::fs::directory_iterator it(Dir, EC), end; it != end && !EC; it.increment(EC)) {
+    StringRef name = sys::path::filename(it->path());
+    if (name.startswith("cfg.") && (name.endswith(".dot") || name.endswith(".dot.gz")))
+      dots.push_back(it->path());
+    else if (name.endswith(".rnpack"))
+      packs.push_back(it->path());
+  }
+  if (EC) {
+    errs() << "Could not read directory: " << Dir << "\n";
+    return false;
+  }
+  std::sort(dots.begin(), dots.end());
+  std::sort(packs.begin(), packs.end());
+
+  std::vector<RnLoadTask> tasks;
+  for (auto &path : dots) {
+    RnLoadTask task;
+    task.Path = path;
+    task.Gz = StringRef(path).endswith(".gz");
+    tasks.push_back(std::move(task));
+  }
+  for (auto &path : packs) {
+    if (!readRnPackIndex(path, tasks))
+      errs() << "Could not read pack index: " << path << "\n";
+  }
+
+  /* 每个线程依次领取下一个任务, 结果按任务顺序存放 */
+  std::vector<RnCfg> results(tasks.size());
+  std::vector<char> ok(tasks.size(), 0);
+  std::atomic<size_t> next(0);
+
+  auto worker = [&]() {
+    std::unique_ptr<MemoryBuffer> buf;
+    std::string unzipped;
+    StringRef data;
+    for (size_t i = next++; i < tasks.size(); i = next++) {
+      results[i].Func = tasks[i].Func;
+      results[i].File = tasks[i].File;
+      ok[i] = readRnTask(tasks[i], buf, unzipped, data) && parseRnCfg(data, results[i]);
+    }
+  };
+
+  if (!Jobs)
+    Jobs = std::max(1u, std::thread::hardware_concurrency());
+  Jobs = std::min<size_t>(Jobs, std::max<size_t>(1, tasks.size()));
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < Jobs; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads)
+    t.join();
+
+  Cfgs.reserve(Cfgs.size() + tasks.size()); // StringMap的移动构造不是noexcept, 扩容时会整体拷贝
+  for (size_t i = 0; i < tasks.size(); i++) {
+    if (ok[i]) {
+      Cfgs.push_back(std::move(results[i]));
+    } else {
+      errs() << "Could not parse cfg: " << tasks[i].Path;
+      if (tasks[i].Packed)
+        errs() << " (" << tasks[i].Func << ")";
+      errs() << "\n";
+    }
+  }
+  return true;
+}
@@ -0,0 +1,113 @@
+/*
+ * RnDuPass输出的cfg的快速读取
+ *
+ * 只解析WriteGraph输出的dot子集:
+ *   digraph "CFG for 'main' function" {
+ *     label="CFG for 'main' function";
+ *     Node0x59af6a0 [shape=record,label="{t.c:2:}"];
+ *     Node0x59af6a0 -> Node0x59b0740;
+ *     Node0x59af6a0 -> Node0x59b0800[rncost=3];
+ *   }
+ * 多个文件在多个线程上并行解析, 每个函数的cfg存为CSR格式, 节点按节点语句的顺序编号
+ */
+#ifndef RN_DOT_H
+#define RN_DOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+
+/* 一个函数的cfg */
+struct RnCfg {
+  std::string Func; // 函数名
+  std::string File; // 函数所在的文件名, 只有从打包文件读取时才有
+
+  std::vector<std::string> Labels;  // <节点编号, 基本块的标签>, 形如"t.c:2:"
+  std::vector<std::string> Names;   // <节点编号, dot中的节点名>, 形如"Node0x59af6a0"
+  llvm::StringMap<uint32_t> LabelIds; // <标签, 第一个使用该标签的节点编号>
+  llvm::StringMap<uint32_t> NameIds;  // <dot中的节点名, 节点编号>
+
+  std::vector<uint32_t> Offsets; // CSR: 节点i的后继为Succs[Offsets[i], Offsets[i + 1])
+  std::vector<uint32_t> Succs;
+  std::vector<uint32_t> Costs; // <边, 代价>, 与Succs对齐, 只有cfg带有-rndu-weighted输出的rncost属性时才有
+
+  bool weighted() const { return !Costs.empty(); }
+  uint32_t cost(uint32_t E) const { return Costs.empty() ? 1 : Costs[E]; }
+
+  uint32_t numNodes() const { return Labels.size(); }
+  uint32_t numEdges() const { return Succs.size(); }
+
+  const uint32_t *succBegin(uint32_t N) const { return Succs.data() + Offsets[N]; }
+  const uint32_t *succEnd(uint32_t N) const { return Succs.data() + Offsets[N + 1]; }
+
+  /**
+   * @brief 按基本块名字查找节点, 与parse.py中getNodeName的规则一致
+   *
+   * @param BBName 形如"t.c:2"
+   * @return int 节点编号, 找不到时为-1
+   */
+  int findNode(llvm::StringRef BBName) const {
+    auto it = LabelIds.find(BBName.str() + ":");
+    return it == LabelIds.end() ? -1 : (int)it->second;
+  }
+
+  /**
+   * @brief 按dot中的节点名查找节点
+   *
+   * @param Name 形如"Node0x59af6a0"
+   * @return int 节点编号, 找不到时为-1
+   */
+  int findNodeName(llvm::StringRef Name) const {
+    auto it = NameIds.find(Name);
+    return it == NameIds.end() ? -1 : (int)it->second;
+  }
+};
+
+
+/**
+ * @brief 由节点标签获得基本块名字, 与parse.py的规则一致: 去掉末尾的":", 最多保留"文件名:行号"两段
+ *
+ * @param Label
+ * @return std::string
+ */
+std::string getRnBBName(llvm::StringRef Label);
+
+
+/**
+ * @brief 解析一个dot格式的cfg
+ *
+ * @param Data
+ * @param Cfg
+ * @return true 解析成功
+ * @return false 不是WriteGraph输出的格式
+ */
+bool parseRnCfg(llvm::StringRef Data, RnCfg &Cfg);
+
+
+/**
+ * @brief 读取RnDuPass输出的文件, 文件不存在时尝试读取压缩后的"<Path>.gz"
+ *
+ * @param Path
+ * @param Data
+ * @return true
+ * @return false 两者都无法读取
+ */
+bool readRnArtifact(const std::string &Path, std::string &Data);
+
+
+/**
+ * @brief 读取目录下的所有cfg: cfg.<函数名>.dot, 压缩后的cfg.<函数名>.dot.gz, 以及打包文件*.rnpack中的cfg
+ *
+ * @param Dir
+ * @param Jobs 线程数, 为0时使用所有核心
+ * @param Cfgs 按文件名排序, 打包文件中的cfg按索引顺序排在其后
+ * @return true
+ * @return false 目录无法读取
+ */
+bool loadRnCfgDir(const std::string &Dir, unsigned Jobs, std::vector<RnCfg> &Cfgs);
+
+#endif /* RN_DOT_H */
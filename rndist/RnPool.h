@@ -0,0 +1,154 @@
+/*
+ * 工作窃取线程池
+ *
+ * 每个线程有自己的任务队列, 从自己队列的尾部取任务, 自己的队列为空时从其他线程队列的头部窃取.
+ * parallelFor在任务内部也可以调用: 等待的线程不会阻塞, 而是继续执行任务, 因此嵌套的并行不会死锁
+ */
+#ifndef RN_POOL_H
+#define RN_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class RnPool {
+public:
+  /**
+   * @brief 创建线程池
+   *
+   * @param Threads 包括调用parallelFor的线程在内的线程数, 为0时使用所有核心
+   */
+  explicit RnPool(unsigned Threads) {
+    if (!Threads)
+      Threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < Threads; i++)
+      Queues.emplace_back(new RnTaskQueue());
+    for (unsigned i = 1; i < Threads; i++)
+      Workers.emplace_back([this, i]() { workerLoop(i); });
+  }
+
+  ~RnPool() {
+    {
+      std::lock_guard<std::mutex> lock(SleepLock);
+      Stop = true;
+    }
+    SleepCV.notify_all();
+    for (auto &t : Workers)
+      t.join();
+  }
+
+  unsigned size() const { return Queues.size(); }
+
+  /**
+   * @brief 并行执行Fn(0), ..., Fn(N - 1), 全部完成后返回, 等待时当前线程也执行任务
+   *
+   * @param N
+   * @param Fn
+   */
+  template <typename FnT>
+  void parallelFor(size_t N, FnT Fn) {
+    if (N <= 1 || Queues.size() == 1) {
+      for (size_t i = 0; i < N; i++)
+        Fn(i);
+      return;
+    }
+
+    std::atomic<size_t> remaining(N);
+    unsigned self = workerId();
+    for (size_t i = N; i-- > 1;) // 倒序入队, 自己从尾部取时按顺序执行
+      push(self, [&Fn, &remaining, i]() {
+        Fn(i);
+        remaining--;
+      });
+    Fn(0);
+    remaining--;
+
+    while (remaining) {
+      if (!runOne(self))
+        std::this_thread::yield();
+    }
+  }
+
+private:
+  struct RnTaskQueue {
+    std::mutex Lock;
+    std::deque<std::function<void()>> Tasks;
+  };
+
+  std::vector<std::unique_ptr<RnTaskQueue>> Queues;
+  std::vector<std::thread> Workers;
+  std::atomic<size_t> Pending{0}; // 所有队列中的任务数
+  bool Stop = false;
+  std::mutex SleepLock;
+  std::condition_variable SleepCV;
+
+  /* 当前线程在线程池中的编号, 不属于线程池的线程使用0号队列 */
+  static unsigned &currentId() {
+    static thread_local unsigned Id = 0;
+    return Id;
+  }
+  unsigned workerId() const { return currentId() < Queues.size() ? currentId() : 0; }
+
+  void push(unsigned Self, std::function<void()> Task) {
+    {
+      std::lock_guard<std::mutex> lock(Queues[Self]->Lock);
+      Queues[Self]->Tasks.push_back(std::move(Task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(SleepLock);
+      Pending++;
+    }
+    SleepCV.notify_one();
+  }
+
+  /**
+   * @brief 执行一个任务: 先取自己队列的尾部, 再依次窃取其他队列的头部
+   *
+   * @param Self
+   * @return true 执行了一个任务
+   * @return false 所有队列都为空
+   */
+  bool runOne(unsigned Self) {
+    std::function<void()> task;
+    for (unsigned k = 0; k < Queues.size() && !task; k++) {
+      RnTaskQueue &q = *Queues[(Self + k) % Queues.size()];
+      std::lock_guard<std::mutex> lock(q.Lock);
+      if (q.Tasks.empty())
+        continue;
+      if (k == 0) {
+        task = std::move(q.Tasks.back());
+        q.Tasks.pop_back();
+      } else {
+        task = std::move(q.Tasks.front());
+        q.Tasks.pop_front();
+      }
+    }
+    if (!task)
+      return false;
+
+    Pending--;
+    task();
+    return true;
+  }
+
+  void workerLoop(unsigned Id) {
+    currentId() = Id;
+    while (true) {
+      if (runOne(Id))
+        continue;
+
+      std::unique_lock<std::mutex> lock(SleepLock);
+      SleepCV.wait(lock, [this]() { return Stop || Pending > 0; });
+      if (Stop)
+        return;
+    }
+  }
+};
+
+#endif /* RN_POOL_H */
@@ -0,0 +1,433 @@
+/*
+ * _rndist: 供parse.py等Python脚本导入的扩展模块
+ *
+ * _rndist.Engine包装RnTaintEngine, 方法与parse.py中的同名函数对应, 参数与返回值也相同(变量集合为set, 距离为dict),
+ * 脚本可以逐个把热点调用替换为Engine的方法, 算法不变:
+ *
+ *   import _rndist
+ *   engine = _rndist.Engine(jobs=0, weighted=False, maxDist=63)
+ *   engine.load("radon1/out-files", "radon1/out-files")
+ *   engine.cfgDistances("", "main", "Node0x59af6a0", True)
+ *
+ * 与parse.py中的dict相同, 找不到行或基本块时抛出KeyError
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+
+#include "RnTaint.h"
+
+using namespace llvm;
+
+
+struct RnPyEngine {
+  PyObject_HEAD
+  RnTaintEngine *Engine;
+};
+
+
+/**
+ * @brief 获取对象中的RnTaintEngine, 没有初始化时抛出异常
+ *
+ * @param Self
+ * @return RnTaintEngine* 没有时为空
+ */
+static RnTaintEngine *getEngine(PyObject *Self) {
+  RnTaintEngine *E = ((RnPyEngine *)Self)->Engine;
+  if (!E)
+    PyErr_SetString(PyExc_RuntimeError, "Engine is not initialized");
+  return E;
+}
+
+
+/**
+ * @brief 查找行或基本块, 找不到时抛出KeyError
+ *
+ * @param E
+ * @param Name 形如"t.c:2"
+ * @return int 找不到时为-1
+ */
+static int findLocOrRaise(const RnTaintEngine &E, const char *Name) {
+  int loc = E.findLoc(Name);
+  if (loc < 0)
+    PyErr_SetString(PyExc_KeyError, Name);
+  return loc;
+}
+
+
+/**
+ * @brief 按parse.py中CFG_CACHE的键查找cfg, 找不到时抛出KeyError
+ *
+ * @param E
+ * @param File 函数所在的文件名, 没有打包文件时为空
+ * @param Func
+ * @return int 找不到时为-1
+ */
+static int findCfgOrRaise(const RnTaintEngine &E, const char *File, const char *Func) {
+  int cfg = E.findCfg(File, Func);
+  if (cfg < 0)
+    PyErr_Format(PyExc_KeyError, "no cfg for (%s, %s)", File, Func);
+  return cfg;
+}
+
+
+/**
+ * @brief Python中字符串的集合(或任意可迭代对象)转为变量集合
+ *
+ * @param E
+ * @param Obj
+ * @param Vars
+ * @return true
+ * @return false 元素不是字符串, 已设置异常
+ */
+static bool toVarSet(RnTaintEngine &E, PyObject *Obj, RnVarSet &Vars) {
+  PyObject *iter = PyObject_GetIter(Obj);
+  if (!iter)
+    return false;
+
+  PyObject *item;
+  while ((item = PyIter_Next(iter))) {
+    Py_ssize_t size;
+    const char *str = PyUnicode_AsUTF8AndSize(item, &size);
+    if (str)
+      Vars.push_back(E.internVar(StringRef(str, size)));
+    Py_DECREF(item);
+    if (!str)
+      break;
+  }
+  Py_DECREF(iter);
+  if (PyErr_Occurred())
+    return false;
+
+  std::sort(Vars.begin(), Vars.end());
+  Vars.erase(std::unique(Vars.begin(), Vars.end()), Vars.end());
+  return true;
+}
+
+
+/**
+ * @brief 变量集合转为Python的set
+ *
+ * @param E
+ * @param Vars
+ * @return PyObject* 失败时为空
+ */
+static PyObject *fromVarSet(const RnTaintEngine &E, const RnVarSet &Vars) {
+  PyObject *set = PySet_New(nullptr);
+  if (!set)
+    return nullptr;
+  for (uint32_t var : Vars) {
+    const std::string &name = E.getVarName(var);
+    PyObject *str = PyUnicode_FromStringAndSize(name.data(), name.size());
+    if (!str || PySet_Add(set, str) < 0) {
+      Py_XDECREF(str);
+      Py_DECREF(set);
+      return nullptr;
+    }
+    Py_DECREF(str);
+  }
+  return set;
+}
+
+
+static PyObject *fromString(const std::string &Str) {
+  return PyUnicode_FromStringAndSize(Str.data(), Str.size());
+}
+
+
+/* Engine(jobs=0, weighted=False, maxDist=63) */
+static int Engine_init(PyObject *Self, PyObject *Args, PyObject *Kwds) {
+  static const char *kwlist[] = {"jobs", "weighted", "maxDist", nullptr};
+  unsigned jobs = 0;
+  int weighted = 0;
+  unsigned maxDist = 63;
+  if (!PyArg_ParseTupleAndKeywords(Args, Kwds, "|IpI", const_cast<char **>(kwlist), &jobs, &weighted, &maxDist))
+    return -1;
+
+  RnPyEngine *self = (RnPyEngine *)Self;
+  delete self->Engine;
+  self->Engine = new RnTaintEngine(jobs, weighted, maxDist);
+  return 0;
+}
+
+
+static void Engine_dealloc(PyObject *Self) {
+  PyTypeObject *type = Py_TYPE(Self);
+  delete ((RnPyEngine *)Self)->Engine;
+  type->tp_free(Self);
+  Py_DECREF(type); // 堆上的类型被其实例引用
+}
+
+
+/* load(path, dotPath) -> bool, 与parse.py的loadArtifacts相同 */
+static PyObject *Engine_load(PyObject *Self, PyObject *Args) {
+  const char *path, *dotPath;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "ss", &path, &dotPath))
+    return nullptr;
+  return PyBool_FromLong(E->load(path, dotPath));
+}
+
+
+/* computeDistances(tSrcsFile, outPath) -> bool, 与parse.py的computeDistances相同, 污点分析在线程池上并行执行 */
+static PyObject *Engine_computeDistances(PyObject *Self, PyObject *Args) {
+  const char *tSrcsFile, *outPath;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "ss", &tSrcsFile, &outPath))
+    return nullptr;
+  return PyBool_FromLong(E->run(tSrcsFile, outPath));
+}
+
+
+/* lineBB(line) -> str, 与LINE_BB_DICT[line]相同 */
+static PyObject *Engine_lineBB(PyObject *Self, PyObject *Args) {
+  const char *line;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "s", &line))
+    return nullptr;
+
+  int loc = findLocOrRaise(*E, line);
+  if (loc < 0)
+    return nullptr;
+  int bb = E->getLineBB(loc);
+  if (bb < 0) {
+    PyErr_SetString(PyExc_KeyError, line);
+    return nullptr;
+  }
+  return fromString(E->getLocName(bb));
+}
+
+
+/* getNodeName(file, func, nodeLabel) -> str, 与parse.py的getNodeName相同, 找不到时为"" */
+static PyObject *Engine_getNodeName(PyObject *Self, PyObject *Args) {
+  const char *file, *func, *nodeLabel;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "sss", &file, &func, &nodeLabel))
+    return nullptr;
+
+  int cfg = findCfgOrRaise(*E, file, func);
+  if (cfg < 0)
+    return nullptr;
+  const RnCfg &C = E->getCfgAt(cfg);
+  int node = C.findNode(nodeLabel);
+  return fromString(node < 0 ? std::string() : C.Names[node]);
+}
+
+
+/* cfgDistances(file, func, node, reverse) -> dict, 与parse.py的cfgDistances相同: <节点名, 最短距离>, 不可达的节点不在其中 */
+static PyObject *Engine_cfgDistances(PyObject *Self, PyObject *Args) {
+  const char *file, *func, *nodeName;
+  int reverse;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "sssp", &file, &func, &nodeName, &reverse))
+    return nullptr;
+
+  int cfg = findCfgOrRaise(*E, file, func);
+  if (cfg < 0)
+    return nullptr;
+  const RnCfg &C = E->getCfgAt(cfg);
+  int node = C.findNodeName(nodeName);
+  if (node < 0) {
+    PyErr_SetString(PyExc_KeyError, nodeName);
+    return nullptr;
+  }
+
+  auto dist = E->distances(cfg, node, reverse);
+  PyObject *res = PyDict_New();
+  if (!res)
+    return nullptr;
+  for (uint32_t n = 0; n < C.numNodes(); n++) {
+    if ((*dist)[n] == UINT32_MAX)
+      continue;
+    PyObject *key = fromString(C.Names[n]), *value = PyLong_FromUnsignedLong((*dist)[n]);
+    int err = !key || !value || PyDict_SetItem(res, key, value) < 0;
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    if (err) {
+      Py_DECREF(res);
+      return nullptr;
+    }
+  }
+  return res;
+}
+
+
+/* shortestPathLength(file, func, source, target) -> int, 不可达时为None */
+static PyObject *Engine_shortestPathLength(PyObject *Self, PyObject *Args) {
+  const char *file, *func, *source, *target;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "ssss", &file, &func, &source, &target))
+    return nullptr;
+
+  int cfg = findCfgOrRaise(*E, file, func);
+  if (cfg < 0)
+    return nullptr;
+  const RnCfg &C = E->getCfgAt(cfg);
+  int src = C.findNodeName(source), dst = C.findNodeName(target);
+  if (src < 0 || dst < 0) {
+    PyErr_SetString(PyExc_KeyError, src < 0 ? source : target);
+    return nullptr;
+  }
+
+  uint32_t d = (*E->distances(cfg, src, false))[dst];
+  if (d == UINT32_MAX)
+    Py_RETURN_NONE;
+  return PyLong_FromUnsignedLong(d);
+}
+
+
+/* isPreTainted(bbname, preSet) -> (bool, set), 与parse.py的isPreTainted相同 */
+static PyObject *Engine_isPreTainted(PyObject *Self, PyObject *Args) {
+  const char *bbname;
+  PyObject *preSetObj;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "sO", &bbname, &preSetObj))
+    return nullptr;
+
+  int bb = findLocOrRaise(*E, bbname);
+  if (bb < 0)
+    return nullptr;
+  if (!E->hasLines(bb)) {
+    PyErr_SetString(PyExc_KeyError, bbname);
+    return nullptr;
+  }
+  RnVarSet preSet, bbDuSet;
+  if (!toVarSet(*E, preSetObj, preSet))
+    return nullptr;
+
+  bool isTainted = E->isPreTainted(bb, preSet, bbDuSet);
+  PyObject *set = fromVarSet(*E, bbDuSet);
+  if (!set)
+    return nullptr;
+  return Py_BuildValue("(NN)", PyBool_FromLong(isTainted), set);
+}
+
+
+/*
+ * isBackTainted(bbname, backSet, distance) -> (bool, set, list), 与parse.py的isBackTainted相同,
+ * parse.py中放入backQueue的三元组(入口基本块, 距离, 变量集合)按顺序放在返回的list中
+ */
+static PyObject *Engine_isBackTainted(PyObject *Self, PyObject *Args) {
+  const char *bbname;
+  PyObject *backSetObj;
+  unsigned distance;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "sOI", &bbname, &backSetObj, &distance))
+    return nullptr;
+
+  int bb = findLocOrRaise(*E, bbname);
+  if (bb < 0)
+    return nullptr;
+  if (!E->hasLines(bb)) {
+    PyErr_SetString(PyExc_KeyError, bbname);
+    return nullptr;
+  }
+  RnVarSet backSet, bbDuSet;
+  if (!toVarSet(*E, backSetObj, backSet))
+    return nullptr;
+
+  std::vector<RnTaintItem> next;
+  bool isTainted = E->isBackTainted(bb, backSet, distance, next, bbDuSet);
+
+  PyObject *queue = PyList_New(0);
+  if (!queue)
+    return nullptr;
+  for (auto &item : next) {
+    PyObject *vars = fromVarSet(*E, item.Vars);
+    PyObject *tuple = vars ? Py_BuildValue("(NIN)", fromString(E->getLocName(item.Loc)), item.CgDist, vars) : nullptr;
+    if (!tuple || PyList_Append(queue, tuple) < 0) {
+      Py_XDECREF(tuple);
+      Py_DECREF(queue);
+      return nullptr;
+    }
+    Py_DECREF(tuple);
+  }
+
+  PyObject *set = fromVarSet(*E, bbDuSet);
+  if (!set) {
+    Py_DECREF(queue);
+    return nullptr;
+  }
+  return Py_BuildValue("(NNN)", PyBool_FromLong(isTainted), set, queue);
+}
+
+
+/* rdSlice(loc, varSet, forward) -> dict, 与parse.py的rdSlice相同 */
+static PyObject *Engine_rdSlice(PyObject *Self, PyObject *Args) {
+  const char *loc;
+  PyObject *varSetObj;
+  int forward;
+  RnTaintEngine *E = getEngine(Self);
+  if (!E || !PyArg_ParseTuple(Args, "sOp", &loc, &varSetObj, &forward))
+    return nullptr;
+
+  RnVarSet vars;
+  if (!toVarSet(*E, varSetObj, vars))
+    return nullptr;
+
+  PyObject *res = PyDict_New();
+  if (!res)
+    return nullptr;
+  std::vector<std::pair<std::string, RnVarSet>> lines;
+  int id = E->findLoc(loc);
+  if (id < 0) {
+    lines.emplace_back(loc, vars); // 没有到达定值的边, 只有loc本身
+  } else {
+    for (auto &plv : E->rdSlice(id, vars, forward))
+      lines.emplace_back(E->getLocName(plv.first), std::move(plv.second));
+  }
+  for (auto &plv : lines) {
+    PyObject *set = fromVarSet(*E, plv.second);
+    if (!set || PyDict_SetItemString(res, plv.first.c_str(), set) < 0) {
+      Py_XDECREF(set);
+      Py_DECREF(res);
+      return nullptr;
+    }
+    Py_DECREF(set);
+  }
+  return res;
+}
+
+
+static PyMethodDef EngineMethods[] = {
+    {"load", Engine_load, METH_VARARGS, "load(path, dotPath) -> bool: read the RnDuPass outputs"},
+    {"computeDistances", Engine_computeDistances, METH_VARARGS, "computeDistances(tSrcsFile, outPath) -> bool: write mydist.cfg.txt and mydist.cfg.phf"},
+    {"lineBB", Engine_lineBB, METH_VARARGS, "lineBB(line) -> str: the block of a line"},
+    {"getNodeName", Engine_getNodeName, METH_VARARGS, "getNodeName(file, func, nodeLabel) -> str: dot node name of a block, \"\" if not found"},
+    {"cfgDistances", Engine_cfgDistances, METH_VARARGS, "cfgDistances(file, func, node, reverse) -> dict: shortest distances from (or to) a node"},
+    {"shortestPathLength", Engine_shortestPathLength, METH_VARARGS, "shortestPathLength(file, func, source, target) -> int or None"},
+    {"isPreTainted", Engine_isPreTainted, METH_VARARGS, "isPreTainted(bbname, preSet) -> (bool, set)"},
+    {"isBackTainted", Engine_isBackTainted, METH_VARARGS, "isBackTainted(bbname, backSet, distance) -> (bool, set, [(entry, distance, set)])"},
+    {"rdSlice", Engine_rdSlice, METH_VARARGS, "rdSlice(loc, varSet, forward) -> dict: lines related through reaching definitions and their tainted variables"},
+    {nullptr, nullptr, 0, nullptr}};
+
+
+static PyType_Slot EngineSlots[] = {
+    {Py_tp_doc, (void *)"Engine(jobs=0, weighted=False, maxDist=63): loaded RnDuPass outputs and the distance/taint kernels of parse.py"},
+    {Py_tp_new, (void *)PyType_GenericNew},
+    {Py_tp_init, (void *)Engine_init},
+    {Py_tp_dealloc, (void *)Engine_dealloc},
+    {Py_tp_methods, (void *)EngineMethods},
+    {0, nullptr}};
+
+
+static PyType_Spec EngineSpec = {"_rndist.Engine", sizeof(RnPyEngine), 0, Py_TPFLAGS_DEFAULT, EngineSlots};
+
+
+static PyModuleDef RnDistModule = {PyModuleDef_HEAD_INIT, "_rndist", "Native graph and distance engine of rndist for parse.py", -1,
+                                   nullptr, nullptr, nullptr, nullptr, nullptr};
+
+
+PyMODINIT_FUNC PyInit__rndist(void) {
+  PyObject *m = PyModule_Create(&RnDistModule);
+  if (!m)
+    return nullptr;
+  PyObject *type = PyType_FromSpec(&EngineSpec);
+  if (!type || PyModule_AddObject(m, "Engine", type) < 0) {
+    Py_XDECREF(type);
+    Py_DECREF(m);
+    return nullptr;
+  }
+  return m;
+}
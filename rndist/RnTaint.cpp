@@ -0,0 +1,1051 @@
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "RnDistTable.h"
+#include "RnTaint.h"
+
+using namespace llvm;
+
+static const uint32_t RN_UNREACHABLE = UINT32_MAX;
+
+
+/* 变量集合的运算, 集合均为有序的vector */
+static bool intersects(const RnVarSet &A, const RnVarSet &B) {
+  auto i = A.begin(), j = B.begin();
+  while (i != A.end() && j != B.end()) {
+    if (*i < *j)
+      i++;
+    else if (*j < *i)
+      j++;
+    else
+      return true;
+  }
+  return false;
+}
+
+static RnVarSet subtractUnite(const RnVarSet &A, const RnVarSet &Sub, const RnVarSet &Add) {
+  RnVarSet diff, res;
+  std::set_difference(A.begin(), A.end(), Sub.begin(), Sub.end(), std::back_inserter(diff));
+  std::set_union(diff.begin(), diff.end(), Add.begin(), Add.end(), std::back_inserter(res));
+  return res;
+}
+
+static void uniteInto(RnVarSet &A, const RnVarSet &B) {
+  RnVarSet res;
+  std::set_union(A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(res));
+  A.swap(res);
+}
+
+
+/*
+ * 与Python heapq(parse.py中的PriorityQueue)相同的堆操作, 只按距离比较.
+ * 距离相同的节点按与parse.py相同的顺序出队, 后向分析把调用加入队列的顺序因此也相同
+ */
+struct RnHeapNode {
+  uint32_t Dist;
+  uint32_t Node;
+};
+
+class RnHeapQueue {
+public:
+  bool empty() const { return Heap.empty(); }
+
+  void push(RnHeapNode N) {
+    Heap.push_back(N);
+    siftDown(0, Heap.size() - 1);
+  }
+
+  RnHeapNode pop() {
+    RnHeapNode last = Heap.back();
+    Heap.pop_back();
+    if (Heap.empty())
+      return last;
+    RnHeapNode res = Heap[0];
+    Heap[0] = last;
+    siftUp(0);
+    return res;
+  }
+
+private:
+  std::vector<RnHeapNode> Heap;
+
+  void siftDown(size_t Start, size_t Pos) {
+    RnHeapNode item = Heap[Pos];
+    while (Pos > Start) {
+      size_t parent = (Pos - 1) >> 1;
+      if (!(item.Dist < Heap[parent].Dist))
+        break;
+      Heap[Pos] = Heap[parent];
+      Pos = parent;
+    }
+    Heap[Pos] = item;
+  }
+
+  void siftUp(size_t Pos) {
+    size_t end = Heap.size(), start = Pos;
+    RnHeapNode item = Heap[Pos];
+    size_t child = 2 * Pos + 1;
+    while (child < end) {
+      size_t right = child + 1;
+      if (right < end && !(Heap[child].Dist < Heap[right].Dist))
+        child = right;
+      Heap[Pos] = Heap[child];
+      Pos = child;
+      child = 2 * Pos + 1;
+    }
+    Heap[Pos] = item;
+    siftDown(start, Pos);
+  }
+};
+
+
+/**
+ * @brief 读取并解析一个json文件, 支持压缩后的"<Path>.gz"
+ *
+ * @param Path
+ * @param V
+ * @return true 文件存在且顶层是对象
+ * @return false
+ */
+static bool loadRnJson(const std::string &Path, json::Value &V) {
+  std::string data;
+  if (!readRnArtifact(Path, data)) {
+    errs() << "Could not read " << Path << "\n";
+    return false;
+  }
+
+  auto ValOrErr = json::parse(data);
+  if (!ValOrErr) {
+    errs() << "Could not parse " << Path << ": " << toString(ValOrErr.takeError()) << "\n";
+    return false;
+  }
+  V = std::move(*ValOrErr);
+  return V.getAsObject() != nullptr;
+}
+
+
+/**
+ * @brief 按键排序后的对象成员. RnDuPass用std::map输出json, 排序后即为文件中的顺序, 与parse.py中dict的遍历顺序一致
+ *
+ * @param O
+ * @return std::vector<std::pair<StringRef, const json::Value *>>
+ */
+static std::vector<std::pair<StringRef, const json::Value *>> sortedItems(const json::Object &O) {
+  std::vector<std::pair<StringRef, const json::Value *>> items;
+  for (auto &kv : O)
+    items.emplace_back(StringRef(kv.first), &kv.second);
+  std::sort(items.begin(), items.end(), [](const std::pair<StringRef, const json::Value *> &A, const std::pair<StringRef, const json::Value *> &B) { return A.first < B.first; });
+  return items;
+}
+
+
+/**
+ * @brief "文件名:行号"中的行号, 无法解析时为0
+ *
+ * @param Loc
+ * @return long
+ */
+static long getRnLine(StringRef Loc) {
+  long line = 0;
+  Loc.split(':').second.split(':').first.getAsInteger(10, line);
+  return line;
+}
+
+
+/**
+ * @brief 把<基本块名字, 距离>写为最小完美哈希表, 算法与pyscripts/rndisttable.py的writeDistTable相同, 输出的文件也相同
+ *
+ * @param Path
+ * @param Names
+ * @param Dists
+ * @return true
+ * @return false
+ */
+static bool writeRnDistTable(const std::string &Path, const std::vector<std::string> &Names, const std::vector<uint32_t> &Dists) {
+  const uint32_t bucketSize = 2;
+  uint32_t n = Names.size();
+  uint32_t nb = std::max<uint32_t>(1, (n + bucketSize - 1) / bucketSize);
+
+  std::vector<uint64_t> hashes(n);
+  for (uint32_t i = 0; i < n; i++)
+    hashes[i] = rn_dist_hash(Names[i].data(), Names[i].size());
+  std::vector<uint64_t> sorted(hashes);
+  std::sort(sorted.begin(), sorted.end());
+  if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+    errs() << "64-bit hash collision between block names\n";
+    return false;
+  }
+
+  std::vector<std::vector<uint32_t>> buckets(nb);
+  for (uint32_t i = 0; i < n; i++)
+    buckets[rn_dist_mix(hashes[i], 0) % nb].push_back(i);
+
+  std::vector<uint32_t> disp(nb, 0), order(nb), singles;
+  std::vector<int64_t> slots(n, -1); // <槽位, 键的下标>
+  for (uint32_t b = 0; b < nb; b++)
+    order[b] = b;
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t A, uint32_t B) { return buckets[A].size() > buckets[B].size(); });
+
+  std::vector<uint32_t> pos;
+  for (uint32_t b : order) {
+    auto &items = buckets[b];
+    if (items.size() <= 1) {
+      if (!items.empty())
+        singles.push_back(b);
+      continue;
+    }
+
+    for (uint32_t d = 1;; d++) {
+      pos.clear();
+      bool ok = true;
+      for (uint32_t i : items) {
+        uint32_t p = rn_dist_mix(hashes[i], d) % n;
+        if (slots[p] >= 0 || std::find(pos.begin(), pos.end(), p) != pos.end()) {
+          ok = false;
+          break;
+        }
+        pos.push_back(p);
+      }
+      if (ok) {
+        disp[b] = d;
+        break;
+      }
+    }
+    for (size_t k = 0; k < items.size(); k++)
+      slots[pos[k]] = items[k];
+  }
+
+  uint32_t freeSlot = 0;
+  for (uint32_t b : singles) {
+    while (slots[freeSlot] >= 0)
+      freeSlot++;
+    disp[b] = RN_DIST_TABLE_DIRECT | freeSlot;
+    slots[freeSlot] = buckets[b][0];
+  }
+
+  /* 字符串池与槽位 */
+  std::string pool;
+  std::vector<uint32_t> offsets(n);
+  for (uint32_t i = 0; i < n; i++) {
+    offsets[i] = pool.size();
+    pool += Names[i];
+    pool.push_back('\0');
+  }
+
+  std::error_code EC;
+  raw_fd_ostream out(Path, EC, sys::fs::F_None);
+  if (EC) {
+    errs() << "Could not write " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  auto write32 = [&](uint32_t V) {
+    char buf[4];
+    support::endian::write32le(buf, V);
+    out.write(buf, 4);
+  };
+  out << RN_DIST_TABLE_MAGIC;
+  write32(n);
+  write32(nb);
+  write32(pool.size());
+  write32(0);
+  for (uint32_t d : disp)
+    write32(d);
+  for (int64_t i : slots) {
+    write32(offsets[i]);
+    write32(Dists[i]);
+  }
+  out << pool;
+  return true;
+}
+
+
+RnTaintEngine::RnTaintEngine(unsigned Jobs, bool Weighted, uint32_t MaxDist) : Pool(Jobs), Weighted(Weighted), MaxDist(MaxDist) {}
+
+
+uint32_t RnTaintEngine::internLoc(StringRef Name) {
+  auto res = LocIds.insert(std::make_pair(Name, (uint32_t)Locs.size()));
+  if (res.second) {
+    Locs.emplace_back();
+    LocNames.push_back(Name.str());
+  }
+  return res.first->second;
+}
+
+
+uint32_t RnTaintEngine::internFunc(StringRef Name) {
+  auto res = FuncIds.insert(std::make_pair(Name, (uint32_t)Funcs.size()));
+  if (res.second) {
+    Funcs.emplace_back();
+    FuncNames.push_back(Name.str());
+  }
+  return res.first->second;
+}
+
+
+uint32_t RnTaintEngine::internVar(StringRef Name) {
+  auto res = VarIds.insert(std::make_pair(Name, (uint32_t)VarNames.size()));
+  if (res.second)
+    VarNames.push_back(Name.str());
+  return res.first->second;
+}
+
+
+int RnTaintEngine::findLoc(StringRef Name) const {
+  auto it = LocIds.find(Name);
+  return it == LocIds.end() ? -1 : (int)it->second;
+}
+
+
+/**
+ * @brief 读取RnDuPass的输出, 与parse.py的loadArtifacts相同, 多组污点源之间共用
+ *
+ * @param Path 存储json等文件的目录
+ * @param DotPath 存储dot文件的目录
+ * @return true
+ * @return false 必需的文件无法读取
+ */
+bool RnTaintEngine::load(const std::string &Path, const std::string &DotPath) {
+  auto toVarSet = [&](const json::Value *V) {
+    RnVarSet set;
+    if (const json::Array *arr = V ? V->getAsArray() : nullptr) {
+      for (auto &e : *arr) {
+        if (auto s = e.getAsString())
+          set.push_back(internVar(*s));
+      }
+    }
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+    return set;
+  };
+
+  json::Value duVar(nullptr), bbLine(nullptr), bbFunc(nullptr), funcEntry(nullptr), funcParam(nullptr), callArgs(nullptr), lineBB(nullptr);
+  if (!loadRnJson(Path + "/duVar.json", duVar) || !loadRnJson(Path + "/bbLine.json", bbLine) || !loadRnJson(Path + "/bbFunc.json", bbFunc) ||
+      !loadRnJson(Path + "/funcEntry.json", funcEntry) || !loadRnJson(Path + "/funcParam.json", funcParam) ||
+      !loadRnJson(Path + "/callArgs.json", callArgs) || !loadRnJson(Path + "/linebb.json", lineBB))
+    return false;
+
+  /* 定义使用关系 */
+  for (auto &kv : sortedItems(*duVar.getAsObject())) {
+    const json::Object *o = kv.second->getAsObject();
+    if (!o)
+      continue;
+    uint32_t loc = internLoc(kv.first);
+    RnLoc &L = Locs[loc];
+    L.HasDU = true;
+    L.DU.HasDef = o->get("def") != nullptr;
+    L.DU.HasUse = o->get("use") != nullptr;
+    L.DU.Def = toVarSet(o->get("def"));
+    L.DU.Use = toVarSet(o->get("use"));
+  }
+
+  /* 开启-rndu-rd时才有的到达定值的边 */
+  if (sys::fs::exists(Path + "/duEdge.json") || sys::fs::exists(Path + "/duEdge.json.gz")) {
+    json::Value duEdge(nullptr);
+    if (!loadRnJson(Path + "/duEdge.json", duEdge))
+      return false;
+    for (auto &dkv : sortedItems(*duEdge.getAsObject())) {
+      const json::Object *uses = dkv.second->getAsObject();
+      if (!uses)
+        continue;
+      uint32_t dLoc = internLoc(dkv.first);
+      for (auto &ukv : sortedItems(*uses)) {
+        uint32_t uLoc = internLoc(ukv.first);
+        RnVarSet vars = toVarSet(ukv.second);
+        Locs[dLoc].DuEdges.emplace_back(uLoc, vars);
+        Locs[uLoc].DuEdgesBack.emplace_back(dLoc, std::move(vars));
+        HasDuEdges = true;
+      }
+    }
+  }
+
+  /* 开启-rndu-field-paths时才有的访问路径: {路径: 上一级路径}, 每个路径的上级为沿上一级路径直到变量本身 */
+  if (sys::fs::exists(Path + "/accessPath.json") || sys::fs::exists(Path + "/accessPath.json.gz")) {
+    json::Value accessPath(nullptr);
+    if (!loadRnJson(Path + "/accessPath.json", accessPath))
+      return false;
+    const json::Object *parents = accessPath.getAsObject();
+    std::vector<std::pair<uint32_t, RnVarSet>> paths;
+    for (auto &kv : sortedItems(*parents)) {
+      RnVarSet ancestors;
+      const json::Value *q = kv.second;
+      for (size_t depth = 0; q && q->getAsString() && depth < parents->size(); depth++) {
+        StringRef parent = *q->getAsString();
+        ancestors.push_back(internVar(parent));
+        q = parents->get(parent);
+      }
+      std::sort(ancestors.begin(), ancestors.end());
+      ancestors.erase(std::unique(ancestors.begin(), ancestors.end()), ancestors.end());
+      paths.emplace_back(internVar(kv.first), std::move(ancestors));
+    }
+    Ancestors.resize(VarNames.size());
+    for (auto &p : paths)
+      Ancestors[p.first] = std::move(p.second);
+  }
+
+  /* 基本块包含的行, 行号从大到小 */
+  for (auto &kv : sortedItems(*bbLine.getAsObject())) {
+    std::vector<uint32_t> lines;
+    if (const json::Array *arr = kv.second->getAsArray()) {
+      for (auto &e : *arr) {
+        if (auto s = e.getAsString())
+          lines.push_back(internLoc(*s));
+      }
+    }
+    std::stable_sort(lines.begin(), lines.end(), [&](uint32_t A, uint32_t B) { return getRnLine(LocNames[A]) > getRnLine(LocNames[B]); });
+    RnLoc &L = Locs[internLoc(kv.first)];
+    L.HasLines = true;
+    L.Lines = std::move(lines);
+  }
+
+  for (auto &kv : sortedItems(*bbFunc.getAsObject())) {
+    if (auto s = kv.second->getAsString()) {
+      uint32_t func = internFunc(*s);
+      Locs[internLoc(kv.first)].Func = func;
+    }
+  }
+
+  for (auto &kv : sortedItems(*funcEntry.getAsObject())) {
+    if (auto s = kv.second->getAsString()) {
+      uint32_t entry = internLoc(s->rtrim(':'));
+      Funcs[internFunc(kv.first)].Entry = entry;
+    }
+  }
+
+  for (auto &kv : sortedItems(*funcParam.getAsObject())) {
+    std::vector<uint32_t> params;
+    if (const json::Array *arr = kv.second->getAsArray()) {
+      for (auto &e : *arr) {
+        if (auto s = e.getAsString())
+          params.push_back(internVar(*s));
+      }
+    }
+    Funcs[internFunc(kv.first)].Params = std::move(params);
+  }
+
+  /* 调用: 只保留有形参的被调用函数, 形参与实参按位置对应 */
+  for (auto &lkv : sortedItems(*callArgs.getAsObject())) {
+    const json::Object *callees = lkv.second->getAsObject();
+    if (!callees)
+      continue;
+    uint32_t loc = internLoc(lkv.first);
+    for (auto &fkv : sortedItems(*callees)) {
+      auto fit = FuncIds.find(fkv.first);
+      if (fit == FuncIds.end() || Funcs[fit->second].Params.empty())
+        continue;
+
+      RnCall call;
+      call.Loc = loc;
+      call.Func = fit->second;
+      const std::vector<uint32_t> &params = Funcs[call.Func].Params;
+      const json::Array *args = fkv.second->getAsArray();
+      size_t num = args ? std::min(params.size(), args->size()) : 0;
+      for (size_t i = 0; i < num; i++) {
+        RnVarSet vars = toVarSet(&(*args)[i]);
+        auto it = std::find_if(call.Pas.begin(), call.Pas.end(), [&](const std::pair<uint32_t, RnVarSet> &P) { return P.first == params[i]; });
+        if (it != call.Pas.end())
+          it->second = std::move(vars); // 同名形参, 与dict的赋值相同
+        else
+          call.Pas.emplace_back(params[i], std::move(vars));
+      }
+
+      Funcs[call.Func].CallsPre.push_back(Calls.size());
+      Locs[loc].CallsBack.push_back(Calls.size());
+      Calls.push_back(std::move(call));
+    }
+  }
+
+  for (auto &kv : sortedItems(*lineBB.getAsObject())) {
+    if (auto s = kv.second->getAsString()) {
+      uint32_t bb = internLoc(*s);
+      Locs[internLoc(kv.first)].BB = bb;
+    }
+  }
+
+  /* cfg, 有打包文件时与parse.py相同, 只按(文件名, 函数名)查找 */
+  if (!loadRnCfgDir(DotPath, Pool.size(), Cfgs))
+    return false;
+  for (auto &cfg : Cfgs)
+    Packed |= !cfg.File.empty();
+
+  NodeLocs.resize(Cfgs.size());
+  for (uint32_t i = 0; i < Cfgs.size(); i++) {
+    RnCfg &cfg = Cfgs[i];
+    for (auto &label : cfg.Labels)
+      NodeLocs[i].push_back(internLoc(getRnBBName(label)));
+
+    if (!cfg.File.empty())
+      PackedCfgs[cfg.File + '\0' + cfg.Func] = i;
+    else if (!Packed)
+      Funcs[internFunc(cfg.Func)].Cfg = i;
+  }
+  return true;
+}
+
+
+/**
+ * @brief 获取基本块所在函数的cfg
+ *
+ * @param Func
+ * @param BB 用于在打包时获得函数所在的文件名
+ * @return int cfg的下标, 没有时为-1
+ */
+int RnTaintEngine::getCfg(uint32_t Func, uint32_t BB) const {
+  if (!Packed)
+    return Funcs[Func].Cfg;
+
+  auto it = PackedCfgs.find(StringRef(LocNames[BB]).split(':').first.str() + '\0' + FuncNames[Func]);
+  return it == PackedCfgs.end() ? -1 : (int)it->second;
+}
+
+
+int RnTaintEngine::findCfg(StringRef File, StringRef Func) const {
+  if (Packed) {
+    auto it = PackedCfgs.find(File.str() + '\0' + Func.str());
+    return it == PackedCfgs.end() ? -1 : (int)it->second;
+  }
+  auto it = FuncIds.find(Func);
+  return it == FuncIds.end() ? -1 : Funcs[it->second].Cfg;
+}
+
+
+/**
+ * @brief cfg中所有节点到Node(Reverse为true)或Node到所有节点的最短距离, 加权时按边的rncost执行Dijkstra, 结果缓存
+ *
+ * @param Cfg
+ * @param Node
+ * @param Reverse
+ * @return std::shared_ptr<const std::vector<uint32_t>> <节点, 距离>, 不可达为RN_UNREACHABLE
+ */
+std::shared_ptr<const std::vector<uint32_t>> RnTaintEngine::distances(uint32_t Cfg, uint32_t Node, bool Reverse) {
+  uint64_t key = ((uint64_t)Cfg << 33) | ((uint64_t)Node << 1) | Reverse;
+  {
+    std::lock_guard<std::mutex> lock(DistLock);
+    auto it = DistCache.find(key);
+    if (it != DistCache.end())
+      return it->second;
+  }
+
+  /* 反向时按终点计数生成前驱的CSR, 边的编号不变 */
+  const RnCfg &cfg = Cfgs[Cfg];
+  uint32_t n = cfg.numNodes();
+  std::vector<uint32_t> offsets, adj, edgeIds;
+  if (Reverse) {
+    offsets.assign(n + 1, 0);
+    for (uint32_t e = 0; e < cfg.numEdges(); e++)
+      offsets[cfg.Succs[e] + 1]++;
+    for (uint32_t i = 1; i <= n; i++)
+      offsets[i] += offsets[i - 1];
+    adj.resize(cfg.numEdges());
+    edgeIds.resize(cfg.numEdges());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint32_t u = 0; u < n; u++) {
+      for (uint32_t e = cfg.Offsets[u]; e < cfg.Offsets[u + 1]; e++) {
+        uint32_t k = fill[cfg.Succs[e]]++;
+        adj[k] = u;
+        edgeIds[k] = e;
+      }
+    }
+  } else {
+    offsets = cfg.Offsets;
+    adj = cfg.Succs;
+    edgeIds.resize(cfg.numEdges());
+    for (uint32_t e = 0; e < cfg.numEdges(); e++)
+      edgeIds[e] = e;
+  }
+
+  auto dist = std::make_shared<std::vector<uint32_t>>(n, RN_UNREACHABLE);
+  std::vector<uint32_t> &d = *dist;
+  d[Node] = 0;
+  if (Weighted) {
+    typedef std::pair<uint32_t, uint32_t> QItem;
+    std::priority_queue<QItem, std::vector<QItem>, std::greater<QItem>> q;
+    q.push(QItem(0, Node));
+    while (!q.empty()) {
+      QItem top = q.top();
+      q.pop();
+      if (top.first > d[top.second])
+        continue;
+      for (uint32_t k = offsets[top.second]; k < offsets[top.second + 1]; k++) {
+        uint32_t nd = top.first + cfg.cost(edgeIds[k]);
+        if (nd < d[adj[k]]) {
+          d[adj[k]] = nd;
+          q.push(QItem(nd, adj[k]));
+        }
+      }
+    }
+  } else {
+    std::vector<uint32_t> queue(1, Node);
+    for (size_t h = 0; h < queue.size(); h++) {
+      uint32_t u = queue[h];
+      for (uint32_t k = offsets[u]; k < offsets[u + 1]; k++) {
+        if (d[adj[k]] == RN_UNREACHABLE) {
+          d[adj[k]] = d[u] + 1;
+          queue.push_back(adj[k]);
+        }
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(DistLock);
+  return DistCache.insert(std::make_pair(key, std::move(dist))).first->second;
+}
+
+
+/**
+ * @brief 沿到达定值的边获取与Loc处的变量相关的所有行及这些行上受污染的变量, 与parse.py的rdSlice相同
+ *
+ * @param Loc
+ * @param Vars Loc处受污染的变量
+ * @param Forward false: 沿use->def的边, 用于前向分析; true: 沿def->use的边, 用于后向分析
+ * @return DenseMap<uint32_t, RnVarSet> <相关的行(包括Loc), 经过的边上的变量以及从该行继续查找的变量>
+ */
+DenseMap<uint32_t, RnVarSet> RnTaintEngine::rdSlice(uint32_t Loc, const RnVarSet &Vars, bool Forward) const {
+  static const RnVarSet empty;
+  DenseMap<uint32_t, RnVarSet> lines;
+  lines[Loc] = Vars;
+  std::vector<std::pair<uint32_t, const RnVarSet *>> stack(1, std::make_pair(Loc, &Vars));
+  while (!stack.empty()) {
+    auto top = stack.back();
+    stack.pop_back();
+    const RnLoc &L = Locs[top.first];
+    for (auto &e : Forward ? L.DuEdges : L.DuEdgesBack) {
+      if (!overlaps(e.second, *top.second))
+        continue;
+      auto it = lines.find(e.first);
+      if (it != lines.end()) {
+        uniteInto(it->second, e.second);
+        continue;
+      }
+      const RnLoc &N = Locs[e.first];
+      const RnVarSet *kindVars = !N.HasDU ? &empty : Forward ? &N.DU.Def : &N.DU.Use;
+      RnVarSet &vars = lines[e.first];
+      vars = e.second;
+      uniteInto(vars, *kindVars);
+      stack.emplace_back(e.first, kindVars);
+    }
+  }
+  return lines;
+}
+
+
+/**
+ * @brief 两个变量集合是否可能访问同一处内存, 与parse.py的overlaps相同: 有相同的变量, 或一方中的访问路径是另一方中路径的上级
+ *
+ * @param A
+ * @param B
+ * @return true
+ * @return false
+ */
+bool RnTaintEngine::overlaps(const RnVarSet &A, const RnVarSet &B) const {
+  if (intersects(A, B))
+    return true;
+  if (Ancestors.empty())
+    return false;
+  for (uint32_t var : A) {
+    if (var < Ancestors.size() && intersects(Ancestors[var], B))
+      return true;
+  }
+  for (uint32_t var : B) {
+    if (var < Ancestors.size() && intersects(Ancestors[var], A))
+      return true;
+  }
+  return false;
+}
+
+
+/**
+ * @brief 按切片判断基本块是否受污染, 与parse.py的sliceTainted相同
+ *
+ * @param Slice rdSlice的结果
+ * @param BB
+ * @param BBDuSet 传入基本块不在切片中时传给下一宽度的变量, 受污染时改为切片中这些行上受污染的变量的并集
+ * @return true
+ * @return false
+ */
+bool RnTaintEngine::sliceTainted(const DenseMap<uint32_t, RnVarSet> &Slice, uint32_t BB, RnVarSet &BBDuSet) const {
+  bool isTainted = false;
+  for (uint32_t line : Locs[BB].Lines) {
+    auto it = Slice.find(line);
+    if (it == Slice.end())
+      continue;
+    if (!isTainted)
+      BBDuSet.clear();
+    isTainted = true;
+    uniteInto(BBDuSet, it->second);
+  }
+  return isTainted;
+}
+
+
+/**
+ * @brief 从Loc开始向前查找所在基本块的起始行, 与parse.py的getbbPreTainted相同
+ *
+ * @param Loc
+ * @return int 基本块, 名字不是"文件名:行号"或找不到时为-1
+ */
+int RnTaintEngine::getbbPreTainted(uint32_t Loc) const {
+  StringRef name = LocNames[Loc];
+  StringRef file, lineStr;
+  std::tie(file, lineStr) = name.split(':');
+  long line;
+  if (lineStr.empty() || lineStr.contains(':') || lineStr.getAsInteger(10, line))
+    return -1; // parse.py中的"struct array?"
+
+  std::string loc = name.str();
+  while (true) {
+    int id = findLoc(loc);
+    if (id >= 0 && Locs[id].BB == id)
+      return id;
+    if (--line < 0)
+      return -1;
+    loc = file.str() + ":" + std::to_string(line);
+  }
+}
+
+
+/**
+ * @brief 查看该基本块是否被前向污染了, 与parse.py的isPreTainted相同
+ *
+ * @param BB
+ * @param PreSet 当前宽度的变量集合
+ * @param BBDuSet 按该基本块各行的定义使用关系更新后的集合
+ * @return true
+ * @return false
+ */
+bool RnTaintEngine::isPreTainted(uint32_t BB, const RnVarSet &PreSet, RnVarSet &BBDuSet) const {
+  bool isTainted = false;
+  BBDuSet = PreSet;
+  for (uint32_t line : Locs[BB].Lines) {
+    const RnLoc &L = Locs[line];
+    if (!L.HasDU || !L.DU.HasDef || !overlaps(L.DU.Def, PreSet))
+      continue;
+    isTainted = true;
+    if (L.DU.HasUse)
+      BBDuSet = subtractUnite(BBDuSet, L.DU.Def, L.DU.Use);
+  }
+  return isTainted;
+}
+
+
+/**
+ * @brief 判断该基本块是否受到污染, 并把基本块中的调用加入队列, 与parse.py的isBackTainted相同
+ *
+ * @param BB
+ * @param BackSet 当前宽度的变量集合
+ * @param Distance 该基本块与污点源之间的距离
+ * @param Next 队列
+ * @param BBDuSet 按该基本块各行的定义使用关系更新后的集合
+ * @return true
+ * @return false
+ */
+bool RnTaintEngine::isBackTainted(uint32_t BB, const RnVarSet &BackSet, uint32_t Distance, std::vector<RnTaintItem> &Next, RnVarSet &BBDuSet) const {
+  bool isTainted = false;
+  BBDuSet = BackSet;
+  const std::vector<uint32_t> &lines = Locs[BB].Lines;
+  for (auto it = lines.rbegin(); it != lines.rend(); it++) {
+    const RnLoc &L = Locs[*it];
+
+    /* 该行调用的函数, 被调用的函数没有入口时其后的调用也不再处理, 与parse.py中的KeyError相同 */
+    for (uint32_t c : L.CallsBack) {
+      const RnCall &call = Calls[c];
+      int32_t entry = Funcs[call.Func].Entry;
+      if (entry < 0)
+        break;
+      RnVarSet nBackSet = BackSet;
+      for (auto &pa : call.Pas) {
+        if (!overlaps(nBackSet, pa.second))
+          continue;
+        nBackSet = subtractUnite(nBackSet, pa.second, RnVarSet(1, pa.first));
+      }
+      if (!nBackSet.empty())
+        Next.push_back(RnTaintItem{(uint32_t)entry, Distance, std::move(nBackSet)});
+    }
+
+    if (!L.HasDU || !L.DU.HasUse || !overlaps(L.DU.Use, BBDuSet))
+      continue;
+    isTainted = true;
+    if (L.DU.HasDef)
+      BBDuSet = subtractUnite(BBDuSet, L.DU.Use, L.DU.Def);
+  }
+  return isTainted;
+}
+
+
+/**
+ * @brief 前向分析中展开一个元素: 函数中能到达污点源的基本块, 以及调用该函数的位置
+ *
+ * @param Item
+ * @param Res
+ */
+void RnTaintEngine::expandPre(const RnTaintItem &Item, RnExpansion &Res) {
+  DenseMap<uint32_t, RnVarSet> rdLines;
+  if (HasDuEdges)
+    rdLines = rdSlice(Item.Loc, Item.Vars, false);
+
+  int bb = getbbPreTainted(Item.Loc);
+  if (bb < 0 || Locs[bb].Func < 0)
+    return;
+  uint32_t func = Locs[bb].Func;
+  int cfgIdx = getCfg(func, bb);
+  if (cfgIdx < 0 || Funcs[func].Entry < 0)
+    return;
+  const RnCfg &cfg = Cfgs[cfgIdx];
+  int target = cfg.findNode(LocNames[bb]), entry = cfg.findNode(LocNames[Funcs[func].Entry]);
+  if (target < 0 || entry < 0)
+    return;
+
+  auto toTarget = distances(cfgIdx, target, true);
+  RnHeapQueue pq;
+  for (uint32_t node = 0; node < cfg.numNodes(); node++) {
+    if ((int)node == target)
+      pq.push(RnHeapNode{Item.CgDist, node});
+    else if ((*toTarget)[node] != RN_UNREACHABLE)
+      pq.push(RnHeapNode{Item.CgDist + (*toTarget)[node], node});
+  }
+
+  uint32_t nowDist = Item.CgDist;
+  RnVarSet preSet = Item.Vars, bbSumDuSet, bbDuSet;
+  while (!pq.empty()) {
+    RnHeapNode node = pq.pop();
+    uint32_t bbname = NodeLocs[cfgIdx][node.Node];
+
+    if (node.Dist != nowDist) {
+      nowDist = node.Dist;
+      preSet.swap(bbSumDuSet);
+      bbSumDuSet.clear();
+    }
+
+    bool isTainted = false;
+    if (node.Dist == Item.CgDist) {
+      isTainted = true;
+      bbSumDuSet = preSet;
+    } else if (Locs[bbname].HasLines) {
+      if (HasDuEdges) {
+        bbDuSet = preSet;
+        isTainted = sliceTainted(rdLines, bbname, bbDuSet);
+      } else
+        isTainted = isPreTainted(bbname, preSet, bbDuSet);
+      uniteInto(bbSumDuSet, bbDuSet);
+    }
+
+    if (node.Dist > MaxDist)
+      continue;
+    if (isTainted)
+      Res.Tainted.emplace_back(bbname, node.Dist);
+  }
+
+  /* 入口无法到达污点源时调用者也无法到达, 没有调用者时前向分析到头了 */
+  if ((*toTarget)[entry] == RN_UNREACHABLE || Funcs[func].CallsPre.empty())
+    return;
+  uint32_t cgDist = Item.CgDist + (*toTarget)[entry];
+
+  for (uint32_t c : Funcs[func].CallsPre) {
+    const RnCall &call = Calls[c];
+    RnVarSet nPreSet = preSet;
+    for (auto &pa : call.Pas) {
+      auto it = std::lower_bound(nPreSet.begin(), nPreSet.end(), pa.first);
+      if (it == nPreSet.end() || *it != pa.first)
+        continue;
+      nPreSet.erase(it);
+      uniteInto(nPreSet, pa.second);
+    }
+    Res.Next.push_back(RnTaintItem{call.Loc, cgDist, std::move(nPreSet)});
+  }
+  Res.Visit = true;
+  Res.VisitLoc = bb;
+}
+
+
+/**
+ * @brief 后向分析中展开一个元素: 函数中污点源能到达的基本块, 以及这些基本块中的调用
+ *
+ * @param Item
+ * @param Res
+ */
+void RnTaintEngine::expandBack(const RnTaintItem &Item, RnExpansion &Res) {
+  DenseMap<uint32_t, RnVarSet> rdLines;
+  if (HasDuEdges)
+    rdLines = rdSlice(Item.Loc, Item.Vars, true);
+
+  int bb = Locs[Item.Loc].BB;
+  if (bb < 0 || Locs[bb].Func < 0)
+    return;
+  int cfgIdx = getCfg(Locs[bb].Func, bb);
+  if (cfgIdx < 0)
+    return;
+  const RnCfg &cfg = Cfgs[cfgIdx];
+  int target = cfg.findNode(LocNames[bb]);
+  if (target < 0)
+    return;
+
+  auto fromTarget = distances(cfgIdx, target, false);
+  RnHeapQueue pq;
+  for (uint32_t node = 0; node < cfg.numNodes(); node++) {
+    if ((int)node == target)
+      pq.push(RnHeapNode{Item.CgDist, node});
+    else if ((*fromTarget)[node] != RN_UNREACHABLE)
+      pq.push(RnHeapNode{Item.CgDist + (*fromTarget)[node], node});
+  }
+
+  uint32_t nowDist = Item.CgDist;
+  RnVarSet backSet = Item.Vars, bbSumDuSet, bbDuSet;
+  while (!pq.empty()) {
+    RnHeapNode node = pq.pop();
+    uint32_t bbname = NodeLocs[cfgIdx][node.Node];
+
+    if (node.Dist != nowDist) {
+      nowDist = node.Dist;
+      backSet.swap(bbSumDuSet);
+      bbSumDuSet.clear();
+    }
+
+    bool isTainted = false;
+    if (Locs[bbname].HasLines) {
+      isTainted = isBackTainted(bbname, backSet, node.Dist, Res.Next, bbDuSet);
+      if (HasDuEdges) {
+        bbDuSet = backSet;
+        isTainted = sliceTainted(rdLines, bbname, bbDuSet);
+      }
+      uniteInto(bbSumDuSet, bbDuSet);
+    }
+    if (node.Dist == Item.CgDist)
+      isTainted = true;
+
+    if (node.Dist > MaxDist)
+      continue;
+    if (isTainted)
+      Res.Tainted.emplace_back(bbname, node.Dist);
+  }
+  Res.Visit = true;
+  Res.VisitLoc = bb;
+}
+
+
+/**
+ * @brief 一个污点源的前向或后向分析.
+ * 队列按层处理: 同一层中未访问过的元素先并行展开, 再按出队顺序合并, 合并时已访问的元素的结果丢弃, 与顺序处理队列的结果相同
+ *
+ * @param Item 污点源
+ * @param Pre 是否为前向分析
+ * @param Column 该任务的距离列
+ */
+void RnTaintEngine::runTask(RnTaintItem Item, bool Pre, RnDistColumn &Column) {
+  DenseSet<uint32_t> visited;
+  std::vector<RnTaintItem> level, next;
+  level.push_back(std::move(Item));
+
+  while (!level.empty()) {
+    /* 同一层中重复的位置只展开第一个, 其余的在合并时若仍未访问再展开 */
+    std::vector<RnExpansion> results(level.size());
+    std::vector<char> expanded(level.size(), 0);
+    DenseSet<uint32_t> seen;
+    std::vector<size_t> todo;
+    for (size_t i = 0; i < level.size(); i++) {
+      if (!visited.count(level[i].Loc) && level[i].CgDist <= MaxDist && seen.insert(level[i].Loc).second)
+        todo.push_back(i);
+    }
+    Pool.parallelFor(todo.size(), [&](size_t k) {
+      size_t i = todo[k];
+      Pre ? expandPre(level[i], results[i]) : expandBack(level[i], results[i]);
+      expanded[i] = 1;
+    });
+
+    next.clear();
+    for (size_t i = 0; i < level.size(); i++) {
+      if (visited.count(level[i].Loc) || level[i].CgDist > MaxDist)
+        continue;
+      RnExpansion &res = results[i];
+      if (!expanded[i])
+        Pre ? expandPre(level[i], res) : expandBack(level[i], res);
+
+      for (auto &t : res.Tainted) {
+        auto ins = Column.Dists.insert(t);
+        if (ins.second)
+          Column.Order.push_back(t.first);
+        else
+          ins.first->second = std::min(ins.first->second, t.second);
+      }
+      for (auto &n : res.Next)
+        next.push_back(std::move(n));
+      if (res.Visit)
+        visited.insert(res.VisitLoc);
+    }
+    level.swap(next);
+  }
+}
+
+
+/**
+ * @brief 根据一组污点源计算各基本块的距离, 输出mydist.cfg.txt与mydist.cfg.phf
+ *
+ * @param TaintFile 每行一个"文件名:行号"
+ * @param OutPath 输出目录
+ * @return true
+ * @return false
+ */
+bool RnTaintEngine::run(const std::string &TaintFile, const std::string &OutPath) {
+  auto BufOrErr = MemoryBuffer::getFile(TaintFile);
+  if (!BufOrErr) {
+    errs() << "Could not read " << TaintFile << "\n";
+    return false;
+  }
+
+  /* 污点源, 去重后保持文件中的顺序, 没有定义使用关系的行忽略 */
+  std::vector<uint32_t> tSrcs;
+  DenseSet<uint32_t> seen;
+  SmallVector<StringRef, 16> lines;
+  (*BufOrErr)->getBuffer().split(lines, '\n');
+  for (StringRef line : lines) {
+    int loc = findLoc(line);
+    if (loc >= 0 && Locs[loc].HasDU && seen.insert(loc).second)
+      tSrcs.push_back(loc);
+  }
+
+  /* 每个污点源的前向与后向分析各为一个任务, 变量集合为空时没有意义 */
+  std::vector<std::pair<RnTaintItem, bool>> tasks;
+  for (uint32_t loc : tSrcs) {
+    const RnLineDU &du = Locs[loc].DU;
+    if (!du.Use.empty())
+      tasks.emplace_back(RnTaintItem{loc, 0, du.Use}, true);
+    if (!du.Def.empty())
+      tasks.emplace_back(RnTaintItem{loc, 0, du.Def}, false);
+  }
+
+  std::vector<RnDistColumn> columns(tasks.size());
+  Pool.parallelFor(tasks.size(), [&](size_t i) { runTask(tasks[i].first, tasks[i].second, columns[i]); });
+
+  /* 合并为各基本块的最小距离, 顺序与parse.py相同 */
+  DenseMap<uint32_t, uint32_t> resIdx;
+  std::vector<std::string> names;
+  std::vector<uint32_t> dists;
+  for (auto &col : columns) {
+    for (uint32_t bb : col.Order) {
+      uint32_t d = col.Dists[bb];
+      auto ins = resIdx.insert(std::make_pair(bb, (uint32_t)names.size()));
+      if (ins.second) {
+        names.push_back(LocNames[bb]);
+        dists.push_back(d);
+      } else {
+        dists[ins.first->second] = std::min(dists[ins.first->second], d);
+      }
+    }
+  }
+
+  std::error_code EC;
+  raw_fd_ostream out(OutPath + "/mydist.cfg.txt", EC, sys::fs::F_None);
+  if (EC) {
+    errs() << "Could not write " << OutPath << "/mydist.cfg.txt: " << EC.message() << "\n";
+    return false;
+  }
+  for (size_t i = 0; i < names.size(); i++)
+    out << names[i] << "," << dists[i] << "\n";
+
+  return writeRnDistTable(OutPath + "/mydist.cfg.phf", names, dists);
+}
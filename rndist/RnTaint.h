@@ -0,0 +1,187 @@
+/*
+ * 前向与后向污点分析的并行实现, 结果与parse.py的computeDistances一致
+ *
+ * 每个污点源的前向分析与后向分析是互相独立的任务, 在工作窃取线程池上并行执行, 每个任务有自己的距离列.
+ * 任务内部的队列按调用层次逐层处理: 同一层中每个函数的展开(cfg上的最短距离与逐块的污点判断)也作为任务并行执行,
+ * 再按parse.py中出队的顺序依次合并visited与下一层的队列, 因此结果与线程数无关.
+ * 所有任务结束后, 各列按任务顺序合并为各基本块的最小距离
+ */
+#ifndef RN_TAINT_H
+#define RN_TAINT_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+
+#include "RnDot.h"
+#include "RnPool.h"
+
+
+typedef std::vector<uint32_t> RnVarSet; // 按编号排序的变量集合
+
+
+/* 队列中的元素, 与parse.py中的三元组相同: <行或基本块, 函数间的距离, 受污染的变量> */
+struct RnTaintItem {
+  uint32_t Loc;
+  uint32_t CgDist;
+  RnVarSet Vars;
+};
+
+
+/* 一个元素展开后的结果 */
+struct RnExpansion {
+  bool Visit = false; // 是否把VisitLoc加入visited
+  uint32_t VisitLoc = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> Tainted; // <受污染的基本块, 距离>
+  std::vector<RnTaintItem> Next;                      // 加入队列的元素
+};
+
+
+/* 一个任务的距离列: <基本块, 最小距离>, 以及基本块第一次受污染的顺序 */
+struct RnDistColumn {
+  llvm::DenseMap<uint32_t, uint32_t> Dists;
+  std::vector<uint32_t> Order;
+};
+
+
+class RnTaintEngine {
+public:
+  /**
+   * @brief
+   *
+   * @param Jobs 线程数, 为0时使用所有核心
+   * @param Weighted 是否按cfg边的rncost计算加权距离, 与parse.py的-w相同
+   * @param MaxDist 与parse.py的MAX_CONCERN_DIST相同
+   */
+  RnTaintEngine(unsigned Jobs, bool Weighted, uint32_t MaxDist);
+
+  /**
+   * @brief 读取RnDuPass的输出, 多组污点源之间共用
+   *
+   * @param Path 存储json等文件的目录
+   * @param DotPath 存储dot文件的目录
+   * @return true
+   * @return false 必需的文件无法读取
+   */
+  bool load(const std::string &Path, const std::string &DotPath);
+
+  /**
+   * @brief 根据一组污点源计算各基本块的距离, 输出mydist.cfg.txt与mydist.cfg.phf
+   *
+   * @param TaintFile 每行一个"文件名:行号"
+   * @param OutPath 输出目录
+   * @return true
+   * @return false
+   */
+  bool run(const std::string &TaintFile, const std::string &OutPath);
+
+  /*
+   * 以下供Python扩展模块(RnPython.cpp)使用, 对应parse.py中的各个函数, 使parse.py等脚本可以逐个替换其中的热点.
+   * 行与基本块用RnLoc的编号表示, 变量用internVar的编号表示
+   */
+
+  int findLoc(llvm::StringRef Name) const;
+  const std::string &getLocName(uint32_t Loc) const { return LocNames[Loc]; }
+  bool hasLines(uint32_t Loc) const { return Locs[Loc].HasLines; }
+
+  /**
+   * @brief 行所在的基本块, 与parse.py的LINE_BB_DICT相同
+   *
+   * @param Loc
+   * @return int 基本块, 没有时为-1
+   */
+  int getLineBB(uint32_t Loc) const { return Locs[Loc].BB; }
+
+  uint32_t internVar(llvm::StringRef Name);
+  const std::string &getVarName(uint32_t Var) const { return VarNames[Var]; }
+
+  /**
+   * @brief 按parse.py中CFG_CACHE的键查找cfg
+   *
+   * @param File 函数所在的文件名, 没有打包文件时为空
+   * @param Func 函数名
+   * @return int cfg的下标, 没有时为-1
+   */
+  int findCfg(llvm::StringRef File, llvm::StringRef Func) const;
+  const RnCfg &getCfgAt(uint32_t Cfg) const { return Cfgs[Cfg]; }
+
+  std::shared_ptr<const std::vector<uint32_t>> distances(uint32_t Cfg, uint32_t Node, bool Reverse);
+  llvm::DenseMap<uint32_t, RnVarSet> rdSlice(uint32_t Loc, const RnVarSet &Vars, bool Forward) const;
+  bool isPreTainted(uint32_t BB, const RnVarSet &PreSet, RnVarSet &BBDuSet) const;
+  bool isBackTainted(uint32_t BB, const RnVarSet &BackSet, uint32_t Distance, std::vector<RnTaintItem> &Next, RnVarSet &BBDuSet) const;
+
+private:
+  /* 一行的定义使用关系 */
+  struct RnLineDU {
+    bool HasDef = false, HasUse = false;
+    RnVarSet Def, Use;
+  };
+
+  /* 一个位置(行或基本块)的所有信息, 没有的字段为-1或空 */
+  struct RnLoc {
+    bool HasDU = false;
+    RnLineDU DU;
+    int32_t BB = -1;   // 所在的基本块, 来自linebb.json
+    int32_t Func = -1; // 基本块所在的函数, 来自bbFunc.json
+    bool HasLines = false;
+    std::vector<uint32_t> Lines;     // 基本块包含的行, 行号从大到小
+    std::vector<uint32_t> CallsBack; // 该行的调用
+    std::vector<std::pair<uint32_t, RnVarSet>> DuEdges, DuEdgesBack; // 到达定值的边
+  };
+
+  /* 一个调用: 所在的行, 被调用的函数, <形参, 实参> */
+  struct RnCall {
+    uint32_t Loc;
+    uint32_t Func;
+    std::vector<std::pair<uint32_t, RnVarSet>> Pas;
+  };
+
+  struct RnFunc {
+    int32_t Entry = -1; // 入口基本块
+    int32_t Cfg = -1;   // 不打包时的cfg
+    std::vector<uint32_t> Params;
+    std::vector<uint32_t> CallsPre; // 调用该函数的调用
+  };
+
+  RnPool Pool;
+  bool Weighted;
+  uint32_t MaxDist;
+
+  llvm::StringMap<uint32_t> LocIds, FuncIds, VarIds;
+  std::vector<std::string> LocNames, FuncNames, VarNames;
+  std::vector<RnLoc> Locs;
+  std::vector<RnFunc> Funcs;
+  std::vector<RnCall> Calls;
+  bool HasDuEdges = false;
+  std::vector<RnVarSet> Ancestors; // <访问路径, 其上级的路径>, 来自accessPath.json, 没有时为空
+
+  std::vector<RnCfg> Cfgs;
+  std::vector<std::vector<uint32_t>> NodeLocs; // <cfg, <节点, 基本块名字>>
+  bool Packed = false;                         // 有打包文件时只按(文件名, 函数名)查找cfg
+  llvm::StringMap<uint32_t> PackedCfgs;        // <"文件名\0函数名", cfg>
+
+  /* <(cfg, 节点, 是否反向), 距离>, 各任务与各组污点源共用 */
+  std::mutex DistLock;
+  llvm::DenseMap<uint64_t, std::shared_ptr<const std::vector<uint32_t>>> DistCache;
+
+  uint32_t internLoc(llvm::StringRef Name);
+  uint32_t internFunc(llvm::StringRef Name);
+
+  int getCfg(uint32_t Func, uint32_t BB) const;
+
+  bool overlaps(const RnVarSet &A, const RnVarSet &B) const;
+  bool sliceTainted(const llvm::DenseMap<uint32_t, RnVarSet> &Slice, uint32_t BB, RnVarSet &BBDuSet) const;
+  int getbbPreTainted(uint32_t Loc) const;
+
+  void expandPre(const RnTaintItem &Item, RnExpansion &Res);
+  void expandBack(const RnTaintItem &Item, RnExpansion &Res);
+  void runTask(RnTaintItem Item, bool Pre, RnDistColumn &Column);
+};
+
+#endif /* RN_TAINT_H */
@@ -0,0 +1,153 @@
+/*
+ * rndist: 在C++中直接处理RnDuPass的输出目录
+ *
+ * rndist load <out-files目录> [-j N]: 并行读取所有cfg并输出统计信息, 用于检查大量历史cfg能否正常解析
+ * rndist dist -p <目录> -d <dot目录> (-t <污点源文件> | -m <清单>) [-w] [-j N]: 与parse.py相同的距离计算, 污点分析并行执行
+ */
+#include <chrono>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "RnDot.h"
+#include "RnTaint.h"
+
+using namespace llvm;
+
+
+/* 命令行参数 */
+static cl::SubCommand LoadCmd("load", "Load all CFGs of an out-files directory and print statistics");
+static cl::opt<std::string> LoadDir(cl::Positional, cl::desc("<out-files dir>"), cl::Required, cl::sub(LoadCmd));
+static cl::opt<unsigned> Jobs("j", cl::desc("Number of threads (0: all cores)"), cl::init(0), cl::sub(*cl::AllSubCommands));
+
+static cl::SubCommand DistCmd("dist", "Compute block distances to taint sources, same output as parse.py");
+static cl::opt<std::string> DistPath("p", cl::desc("Directory of the json files, results are written here"), cl::Required, cl::sub(DistCmd));
+static cl::opt<std::string> DistDot("d", cl::desc("Directory of the dot files"), cl::Required, cl::sub(DistCmd));
+static cl::opt<std::string> DistTaint("t", cl::desc("File of taint sources, one filename:line per line"), cl::sub(DistCmd));
+static cl::opt<std::string> DistManifest("m", cl::desc("Batch mode: manifest with one \"taint-file [out-dir]\" per line"), cl::sub(DistCmd));
+static cl::opt<bool> DistWeighted("w", cl::desc("Use the rncost of cfg edges (-rndu-weighted) as edge weights"), cl::sub(DistCmd));
+static cl::opt<unsigned> DistMax("max-dist", cl::desc("Blocks farther than this are ignored (MAX_CONCERN_DIST of parse.py)"), cl::init(63), cl::sub(DistCmd));
+
+
+/**
+ * @brief 读取目录下的所有cfg并输出节点数, 边数与耗时
+ *
+ * @return int
+ */
+static int runLoad() {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<RnCfg> cfgs;
+  if (!loadRnCfgDir(LoadDir, Jobs, cfgs))
+    return 1;
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t nodes = 0, edges = 0;
+  for (auto &cfg : cfgs) {
+    nodes += cfg.numNodes();
+    edges += cfg.numEdges();
+  }
+  outs() << "cfgs: " << cfgs.size() << ", nodes: " << nodes << ", edges: " << edges << ", time: " << ms << " ms\n";
+  return 0;
+}
+
+
+/**
+ * @brief 读取批量计算的清单, 规则与parse.py的readManifest相同: 每行为"污点源文件 [输出目录]", 空行与#开头的行忽略,
+ * 相对路径相对于清单所在的目录, 没有输出目录时为<-p目录>/batch/<污点源文件名去掉扩展名>
+ *
+ * @param Manifest
+ * @param Jobs <污点源文件, 输出目录>
+ * @return true
+ * @return false
+ */
+static bool readManifest(const std::string &Manifest, std::vector<std::pair<std::string, std::string>> &Jobs) {
+  auto BufOrErr = MemoryBuffer::getFile(Manifest);
+  if (!BufOrErr) {
+    errs() << "Could not read " << Manifest << "\n";
+    return false;
+  }
+
+  SmallString<256> base(Manifest);
+  sys::fs::make_absolute(base);
+  sys::path::remove_filename(base);
+  auto resolve = [&](StringRef P) {
+    if (sys::path::is_absolute(P))
+      return P.str();
+    SmallString<256> res(base);
+    sys::path::append(res, P);
+    return std::string(res.str());
+  };
+
+  for (line_iterator it(**BufOrErr, false); !it.is_at_end(); ++it) {
+    SmallVector<StringRef, 4> fields;
+    SplitString(*it, fields);
+    if (fields.empty() || fields[0].startswith("#"))
+      continue;
+
+    std::string outPath;
+    if (fields.size() > 1) {
+      outPath = resolve(fields[1]);
+    } else {
+      SmallString<256> res(DistPath);
+      sys::path::append(res, "batch", sys::path::stem(fields[0]));
+      outPath = std::string(res.str());
+    }
+    Jobs.emplace_back(resolve(fields[0]), outPath);
+  }
+  return true;
+}
+
+
+/**
+ * @brief 计算一组或清单中每组污点源的距离, RnDuPass的输出只读取一次
+ *
+ * @return int
+ */
+static int runDist() {
+  if (DistTaint.empty() == DistManifest.empty()) {
+    errs() << "Exactly one of -t and -m is required\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  RnTaintEngine engine(Jobs, DistWeighted, DistMax);
+  if (!engine.load(DistPath, DistDot))
+    return 1;
+
+  std::vector<std::pair<std::string, std::string>> jobs;
+  if (!DistTaint.empty())
+    jobs.emplace_back(DistTaint, DistPath);
+  else if (!readManifest(DistManifest, jobs))
+    return 1;
+
+  for (size_t i = 0; i < jobs.size(); i++) {
+    if (!DistManifest.empty()) {
+      outs() << "[" << i + 1 << "/" << jobs.size() << "] " << jobs[i].first << " -> " << jobs[i].second << "\n";
+      sys::fs::create_directories(jobs[i].second);
+    }
+    if (!engine.run(jobs[i].first, jobs[i].second))
+      return 1;
+  }
+
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  outs() << "Calculation is finished, time: " << ms << " ms\n";
+  return 0;
+}
+
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Radon distance tools\n");
+
+  if (LoadCmd)
+    return runLoad();
+  if (DistCmd)
+    return runDist();
+
+  cl::PrintHelpMessage();
+  return 1;
+}